@@ -225,6 +225,7 @@ inline bool cAC3::crc_check(const uint_8 *const data, const size_t num_bytes)
 //   for a full AC3 frame found in the segment.
 const frame_t & cAC3::Frame(const uint_8 *&out, const uint_8 *const tail)
 {
+    const uint_8 *from;
     play.burst = (uint_32 *)0;
     play.size  = 0;
 
@@ -242,11 +243,16 @@ resync:
     // Need the next 4 bytes to decide how big
     // and which mode the frame is
     //
+    from = out;
     while(s.pos < 6) {
 	if (out >= tail)
-	    goto done;
+	    break;
 	payload[s.pos++] = *out++;
     }
+    if (taints && tainted(from, out))
+	s.damaged = true;
+    if (s.pos < 6)
+	goto done;
 
     //
     // Parse and check syncinfo if not known for this frame
@@ -256,6 +262,7 @@ resync:
 	if (!s.syncinfo.frame_size) {
 	    s.syncword = 0xffff;
 	    s.pos = 2;
+	    s.damaged = false;
 	    esyslog("AC3PCM: ** Invalid frame found - try to syncing **");
 	    if (out >= tail)
 		goto done;
@@ -271,6 +278,7 @@ resync:
     if (s.syncinfo.sampling_rate != sample_rate) {
 	s.syncword = 0xffff;
 	s.pos = 2;
+	s.damaged = false;
 	s.payload_size = 0;
 	esyslog("AC3PCM: ** Invalid sample rate found - try to syncing **");
 	if (out >= tail)
@@ -285,17 +293,36 @@ resync:
 	    goto done;
 	if (rest + s.pos > s.payload_size)
 	    rest = s.payload_size - s.pos;
+	if (taints && tainted(out, out + rest))
+	    s.damaged = true;
 	memcpy(&payload[s.pos], out, rest);
 	s.pos += rest;
 	out   += rest;
     }
 
+    //
+    // Known to be damaged by lost or erroneous TS packets, therefore
+    // skip the CRC and conceal with the last frame and error bit set.
+    //
+    if (s.damaged) {
+	s.syncword = 0xffff;
+	s.pos = 2;
+	s.payload_size = 0;
+	s.damaged = false;
+	if (!last.burst)
+	    goto resync;
+	dsyslog("AC3PCM: ** Damaged frame - conceal by last frame **");
+	play = conceal();
+	goto done;
+    }
+
     //
     // Check the crc over the entire frame
     //
     if(!crc_check(payload + 2, s.payload_size - 2)) {
 	s.syncword = 0xffff;
 	s.pos = 2;
+	s.damaged = false;
 	s.payload_size = 0;
 #ifdef USE_LAST_FRAME
 	dsyslog("AC3PCM: ** CRC failed - repeat last frame **");
@@ -59,6 +59,7 @@ private:
     struct {
 	size_t    pos;
 	size_t    payload_size;
+	bool      damaged;
 	ac3info_t syncinfo;
 	uint_16   syncword;
     } s;
@@ -76,6 +77,7 @@ private:
     inline void reset_scan (void)
     {
 	s.pos = 2;
+	s.damaged = false;
 	s.syncword = 0xffff;
 	s.payload_size = 0;
 	memset(&s.syncinfo, 0, sizeof(ac3info_t));
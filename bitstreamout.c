@@ -42,6 +42,7 @@
 #include "lpcm.h"
 #include "mp2.h"
 #include "shm_memory_tool.h"
+#include "realtime.h"
 
 static const char *version	 = VERSION;
 static const char *description	 = "bit stream out to S/P-DIF of a sound card";
@@ -58,7 +59,9 @@ static ctrl_t setup = {
 	0,	// opt.adelay
 	false,	// opt.type
 	true,	// opt.variable
-	false	// opt.mmap
+	false,	// opt.mmap
+	0,	// opt.zapback
+	false	// opt.latency
     }
 };
 
@@ -216,12 +219,14 @@ const char *cBitStreamOut::MainMenuEntry(void)
 
 bool cBitStreamOut::Start(void)
 {
+    rt_lock();
     setup.buf = (uint_8*)shm_malloc(sizeof(uint_8)*OVERALL_MEM, MAP_MEM);
 
     if (setup.buf == NULL) {
 	esyslog("cBitStreamOut::Start() shm_malloc failed\n");
 	goto err;
     }
+    rt_memory(setup.buf, sizeof(uint_8)*OVERALL_MEM);
 
     if (!(mp2dec = mp2.Initialize())) {
        esyslog("cBitStreamOut::Start() mp2 initialization failed\n");
@@ -231,10 +236,10 @@ bool cBitStreamOut::Start(void)
     if (!(bounce = new cBounce(setup.buf, BOUNCE_MEM)))
 	goto err;
 
-    ac3.SetBuffer(setup.buf + SPDIF_START);
-    dts.SetBuffer(setup.buf + SPDIF_START);
-    pcm.SetBuffer(setup.buf + SPDIF_START);
-    mp2.SetBuffer(setup.buf + SPDIF_START);
+    ac3.SetBuffer(setup.buf + SPDIF_START, setup.buf + STAGE_START, STAGE_MEM);
+    dts.SetBuffer(setup.buf + SPDIF_START, setup.buf + STAGE_START, STAGE_MEM);
+    pcm.SetBuffer(setup.buf + SPDIF_START, setup.buf + STAGE_START, STAGE_MEM);
+    mp2.SetBuffer(setup.buf + SPDIF_START, setup.buf + STAGE_START, STAGE_MEM);
 
     if (!(ReplayOutSPDif = new cReplayOutSPDif(spdifDev, setup, bounce, SPDIFmute)))
 	goto err;
@@ -266,7 +271,15 @@ err:
 const char *cBitStreamOut::CommandLineHelp(void)
 {
     return "  -o,        --onoff        enable an control entry in the main menu\n"
-	   "  -m script, --mute=script  script for en/dis-able the spdif interface\n";
+	   "  -m script, --mute=script  script for en/dis-able the spdif interface\n"
+	   "  -r policy, --realtime=policy\n"
+	   "                            scheduling of a thread class, policy is\n"
+	   "                            class=sched[:priority][@cpus] with the class\n"
+	   "                            output, receiver, or decoder and sched other,\n"
+	   "                            fifo, rr, or deadline (priority runtime/period\n"
+	   "                            in usec), e.g. -r output=fifo:70@3\n"
+	   "  -l [all], --lock[=all]    lock and prefault the buffers and thread stacks,\n"
+	   "                            with all the whole memory of VDR\n";
 }
 
 bool cBitStreamOut::ProcessArgs(int argc, char *argv[])
@@ -276,6 +289,8 @@ bool cBitStreamOut::ProcessArgs(int argc, char *argv[])
     {
 	{ "onoff", no_argument,		NULL, 'o' },
 	{ "mute",  required_argument,	NULL, 'm' },
+	{ "realtime", required_argument, NULL, 'r' },
+	{ "lock",  optional_argument,	NULL, 'l' },
 	{  NULL,   no_argument,		NULL,  0  },
     };
 
@@ -285,7 +300,7 @@ bool cBitStreamOut::ProcessArgs(int argc, char *argv[])
     // own options already scanned.
     optarg = NULL;
     optind = opterr = optopt = 0;
-    while ((c = getopt_long(argc, argv, "om:", long_option, NULL)) > 0) {
+    while ((c = getopt_long(argc, argv, "om:r:l::", long_option, NULL)) > 0) {
 	switch (c) {
 	case 'o':
 	    onoff = true;
@@ -298,6 +313,14 @@ bool cBitStreamOut::ProcessArgs(int argc, char *argv[])
 		ret = false;
 	    }
 	    break;
+	case 'r':
+	    if (!rt_parse(optarg))
+		ret = false;
+	    break;
+	case 'l':
+	    if (!rt_memlock(optarg))
+		ret = false;
+	    break;
 	default:
 	    ret = false;
 	    break;
@@ -324,6 +347,8 @@ bool cBitStreamOut::SetupParse(const char *Name, const char *Value)
     else if (!strcasecmp(Name, "IEC958"))     setup.opt.type     = atoi(Value);
     else if (!strcasecmp(Name, "VariableIO")) setup.opt.variable = atoi(Value);
     else if (!strcasecmp(Name, "MemoryMap"))  setup.opt.mmap     = atoi(Value);
+    else if (!strcasecmp(Name, "ZapBack"))    setup.opt.zapback  = atoi(Value);
+    else if (!strcasecmp(Name, "LowLatency")) setup.opt.latency  = atoi(Value);
     else if (!strcasecmp(Name, "Active")) {
 	(active    = atoi(Value)) ? set_setup(ACTIVE)    : clear_setup(ACTIVE);
     } else if (!strcasecmp(Name, "Mp2Enable")) {
@@ -458,6 +483,8 @@ void cMenuSetupBSO::Set(void)
     Add(new cMenuEditBoolItem("IEC958",     &(opt.type),     "Con", "Pro"));
     Add(new cMenuEditBoolItem("VariableIO", &(opt.variable), "No",  "Yes"));
     Add(new cMenuEditBoolItem("MemoryMap",  &(opt.mmap),     "No",  "Yes"));
+    Add(new cMenuEditIntItem ("ZapBack",    &(opt.zapback),   0, ZAPBACK_MAX));
+    Add(new cMenuEditBoolItem("LowLatency", &(opt.latency),  "No",  "Yes"));
     (active)    ? set_setup(ACTIVE)    : clear_setup(ACTIVE);
     (mp2enable) ? set_setup(MP2ENABLE) : clear_setup(MP2ENABLE);
     switch (mp2spdif) {
@@ -484,6 +511,8 @@ void cMenuSetupBSO::Store(void)
     SetupStore("IEC958",     setup.opt.type     = opt.type);
     SetupStore("VariableIO", setup.opt.variable = opt.variable);
     SetupStore("MemoryMap",  setup.opt.mmap     = opt.mmap);
+    SetupStore("ZapBack",    setup.opt.zapback  = opt.zapback);
+    SetupStore("LowLatency", setup.opt.latency  = opt.latency);
     SetupStore("Active",     ((active)    ? true : false));
     SetupStore("Mp2Enable",  ((mp2enable) ? true : false));
     SetupStore("Mp2Out",     mp2out[mp2spdif]);
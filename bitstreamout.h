@@ -31,9 +31,15 @@
 #define BOUNCE_MEM	KILOBYTE(16*64)
 #define TRANSFER_MEM	KILOBYTE(64)
 #define SPDIF_MEM	(2*SPDIF_BURST_SIZE)
-#define OVERALL_MEM	(BOUNCE_MEM+TRANSFER_MEM+SPDIF_MEM)
+#define PESQUEUE_MEM	KILOBYTE(4*64)
+#define STAGE_MEM	KILOBYTE(64)
+#define TRAIN_MEM	KILOBYTE(64)
+#define OVERALL_MEM	(BOUNCE_MEM+TRANSFER_MEM+SPDIF_MEM+PESQUEUE_MEM+STAGE_MEM+TRAIN_MEM)
 #define TRANSFER_START	 BOUNCE_MEM
 #define SPDIF_START	(BOUNCE_MEM+TRANSFER_MEM)
+#define PESQUEUE_START	(BOUNCE_MEM+TRANSFER_MEM+SPDIF_MEM)
+#define STAGE_START	(BOUNCE_MEM+TRANSFER_MEM+SPDIF_MEM+PESQUEUE_MEM)
+#define TRAIN_START	(BOUNCE_MEM+TRANSFER_MEM+SPDIF_MEM+PESQUEUE_MEM+STAGE_MEM)
 
 typedef struct _opt {
     int card;
@@ -45,6 +51,8 @@ typedef struct _opt {
     int mmap;
     int variable;
     int type;
+    int zapback;
+    int latency;
 } opt_t;
 
 #define test_and_set_setup(flag)         test_and_set_bit(SETUP_ ## flag, &(setup.flags))
@@ -62,7 +70,6 @@ typedef struct _ctrl {
 #define SETUP_LIVE	4
 #define SETUP_MP2ENABLE	5
 #define SETUP_MP2DITHER	6
-#define SETUP_STILLPIC	7
 #define SETUP_CLEAR	8
 #define SETUP_MP2SPDIF	9
     volatile flags_t flags;
@@ -24,6 +24,9 @@
 
 #include <string.h>
 #include <sys/time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <unistd.h>
 #include <vdr/config.h>
 #include <vdr/thread.h>
 #include "types.h"
@@ -124,6 +127,93 @@ public:
     inline void Clear(void) const {}
 };
 
+//
+// Grace periods for readers without locks: a reader counts itself
+// within the slot of the current epoch, a writer which has replaced
+// a pointer flips the epoch twice and waits until the readers of the
+// old slot have left.  Only the writer may wait, the readers never
+// block and must not wait on the writer within their section.  The
+// writer sleeps on the futex of the reader count and is woken by the
+// last reader leaving, this as the readers may run with a lower
+// priority than the realtime writer.
+//
+class cGrace {
+private:
+    volatile int epoch;
+    volatile int readers[2];
+    volatile int waiting;
+    static inline void futex(volatile int *addr, const int op, const int val)
+    {
+	struct timespec tmo = { 0, 10000000 };	// Never miss a wakeup forever
+	(void)syscall(SYS_futex, addr, op, val, (op == FUTEX_WAIT) ? &tmo : NULL, NULL, 0);
+    }
+public:
+    cGrace(void) : epoch(0), waiting(0) { readers[0] = readers[1] = 0; }
+    inline int Enter(void)
+    {
+	const int slot = epoch & 1;
+	__sync_add_and_fetch(&readers[slot], 1);
+	return slot;
+    }
+    inline void Leave(const int slot)
+    {
+	if (__sync_sub_and_fetch(&readers[slot], 1) == 0 && waiting)
+	    futex(&readers[slot], FUTEX_WAKE, 1);
+    }
+    inline void Synchronize(void)
+    {
+	for (int n = 0; n < 2; n++) {
+	    const int slot = __sync_fetch_and_add(&epoch, 1) & 1;
+	    int count;
+	    __sync_add_and_fetch(&waiting, 1);
+	    while ((count = readers[slot]))
+		futex(&readers[slot], FUTEX_WAIT, count);
+	    __sync_sub_and_fetch(&waiting, 1);
+	}
+    }
+};
+
+class cGraceLock {
+private:
+    cGrace &grace;
+    const int slot;
+public:
+    cGraceLock(cGrace &g) : grace(g), slot(g.Enter()) {}
+    ~cGraceLock(void) { grace.Leave(slot); }
+};
+
+//
+// Pointer published by a writer and read without any lock, the
+// object behind an old pointer may be reset or released after
+// Synchronize() has returned.
+//
+template <class T> class cPublish : public cGrace {
+private:
+    T *volatile ptr;
+public:
+    cPublish(T *p = (T*)0) : cGrace(), ptr(p) {}
+    inline T *Get(void) const
+    {
+	T *p = ptr;
+	mbarrier();
+	return p;
+    }
+    inline void Set(T *p)
+    {
+	mbarrier();
+	ptr = p;
+	mbarrier();
+    }
+    inline T *Swap(T *p)
+    {
+	T *old = __sync_lock_test_and_set(&ptr, p);
+	mbarrier();
+	return old;
+    }
+};
+
+#define BOUNCE_TAINTS	16			// Remembered damaged byte ranges
+
 class cBounce {
 private:
     uint_8 *const data;
@@ -134,13 +224,46 @@ private:
     volatile size_t threshold;
     cIoMutex mutex;
     cIoWatch iowatch;
-    inline void reset(void) { avail = head = tail = 0; };
+    //
+    // Absolute stream positions of stored and fetched bytes, used
+    // to remember the byte ranges known to be damaged (lost or
+    // erroneous TS packets) until they have been fetched.
+    //
+    uint_64 ipos, opos, lpos;
+    struct {
+	uint_64 from, to;
+    } taint[BOUNCE_TAINTS];
+    int taints;
+    inline void reset(void)
+    {
+	avail = head = tail = 0;
+	lpos = opos = ipos;
+	taints = 0;
+    };
+    inline void mark(const size_t len)
+    {
+	if (taints && taint[taints-1].to == ipos) {
+	    taint[taints-1].to += len;	// Merge with previous range
+	    return;
+	}
+	if (taints >= BOUNCE_TAINTS) {	// Forget the oldest range
+	    memmove(&taint[0], &taint[1], (BOUNCE_TAINTS-1)*sizeof(taint[0]));
+	    taints--;
+	}
+	taint[taints].from = ipos;
+	taint[taints].to   = ipos + len;
+	taints++;
+    };
     inline const size_t stored(void) const { return avail; }
 public:
     cBounce(uint_8 *buf, size_t len)
     : data(buf), size(len), head(0), tail(0), avail(0),
-      threshold(0), mutex(), iowatch() {}
-    inline bool store(const uint_8 *buf, const size_t len, const bool wakeup = true)
+      threshold(0), mutex(), iowatch(), ipos(0), opos(0), lpos(0), taints(0) {}
+    //
+    // The first `bad' bytes of the stored data are known to be damaged
+    //
+    inline bool store(const uint_8 *buf, const size_t len, const bool wakeup = true,
+		      const size_t bad = 0)
     {
 	bool ret = false;
 	size_t free;
@@ -156,6 +279,10 @@ public:
 	if (free > len)
 	    free = len;
 
+	if (bad)
+	    mark((bad > len) ? len : bad);
+	ipos += len;
+
 	if (tail+free > size) {         // Case of rolling over in ring buffer
 	    size_t roll = size - tail;
 	    memcpy(data+tail, buf, roll);
@@ -182,6 +309,7 @@ public:
 	   goto out;
 
 	mutex.Lock();
+	lpos = opos;
 	if (!avail)
 	   goto unl;
 
@@ -201,11 +329,36 @@ public:
 	buf   += want;
 	avail -= want;
 	head   = (head + want) % size;
+	opos  += (buf - start);
     unl:
 	mutex.Unlock();
     out:
 	return (buf - start);
     };
+    //
+    // Return the damaged byte ranges of the data got by the last
+    // fetch() relative to the start of that data.
+    //
+    inline int damaged(size_t *from, size_t *to, const int max)
+    {
+	int n = 0, i;
+	mutex.Lock();
+	for (i = 0; i < taints && n < max; i++) {
+	    if (taint[i].to <= lpos || taint[i].from >= opos)
+		continue;
+	    from[n] = (taint[i].from > lpos) ? (size_t)(taint[i].from - lpos) : 0;
+	    to[n]   = (size_t)(((taint[i].to < opos) ? taint[i].to : opos) - lpos);
+	    n++;
+	}
+	for (i = 0; i < taints && taint[i].to <= opos; i++)
+	    ;
+	if (i) {			// Forget ranges already fetched
+	    memmove(&taint[0], &taint[i], (taints-i)*sizeof(taint[0]));
+	    taints -= i;
+	}
+	mutex.Unlock();
+	return n;
+    };
     inline const void flush(void)	{ mutex.Lock(); reset(); mutex.Unlock(); };
     inline const void bank(size_t val)	{ threshold = val; };
     inline const void signal(void)	{ iowatch.Signal(true); };
@@ -223,4 +376,112 @@ public:
 					{ return (getfree() > min); }
     inline const size_t getused(void)	{ return stored(); }
 };
+
+//
+// Lock free queue of PES packets with exactly one writer and one
+// reader, each packet is stored as a whole together with its id.
+//
+class cPesQueue {
+private:
+    typedef struct _entry {
+	uint_32 len;
+	uint_8  id;
+	uint_8  gap;				// Packets dropped before this one
+	uint_8  pad[2];
+    } entry_t;
+    #define PESQUEUE_WRAP	0xffffffff
+    #define PESQUEUE_ALIGN(x)	(((x)+(sizeof(entry_t)-1))&~(sizeof(entry_t)-1))
+    uint_8 *const data;
+    const size_t size;
+    volatile size_t wr;				// Owned by the writer
+    volatile size_t rd;				// Owned by the reader
+    bool gap;					// Owned by the writer
+    size_t next;				// Owned by the reader
+    cIoWatch iowatch;
+public:
+    cPesQueue(uint_8 *buf, size_t len)
+    : data(buf), size(len & ~(sizeof(entry_t)-1)), wr(0), rd(0), gap(false),
+      next(0), iowatch() {}
+    //
+    // Writer: never blocks, returns false if the packet was dropped.
+    // The reader is woken only if it has emptied the queue before.
+    //
+    inline bool put(const uint_8 *buf, const size_t len, const uint_8 id)
+    {
+	const size_t need = PESQUEUE_ALIGN(sizeof(entry_t) + len);
+	const size_t r = rd;
+	const size_t last = wr;
+	size_t w = last;
+	entry_t *ent;
+
+	if (w >= r) {
+	    if ((size - w > need) || (size - w == need && r > 0))
+		goto copy;
+	    if (r > need) {			// Roll over at the end of ring
+		((entry_t *)(data + w))->len = PESQUEUE_WRAP;
+		w = 0;
+		goto copy;
+	    }
+	} else if (r - w > need)
+	    goto copy;
+
+	gap = true;				// Not empty, reader is awake
+	return false;
+    copy:
+	ent = (entry_t *)(data + w);
+	ent->len = len;
+	ent->id  = id;
+	ent->gap = gap;
+	gap = false;
+	memcpy(data + w + sizeof(entry_t), buf, len);
+	mbarrier();
+	wr = (w + need) % size;
+	mbarrier();
+	if (rd == last)				// Was empty, reader may sleep
+	    iowatch.Signal();
+	return true;
+    };
+    //
+    // Reader: returns the oldest packet without removing it,
+    // lost is set if the writer has dropped packets before.
+    //
+    inline bool get(const uint_8 *&buf, int &len, uint_8 &id, bool &lost)
+    {
+	size_t r = rd;
+	entry_t *ent;
+
+	if (r == wr)
+	    return false;
+	mbarrier();
+	ent = (entry_t *)(data + r);
+	if (ent->len == PESQUEUE_WRAP) {
+	    r = 0;
+	    ent = (entry_t *)data;
+	}
+	buf  = data + r + sizeof(entry_t);
+	len  = ent->len;
+	id   = ent->id;
+	lost = ent->gap;
+	next = (r + PESQUEUE_ALIGN(sizeof(entry_t) + len)) % size;
+	return true;
+    };
+    //
+    // Reader: remove the packet got by get() above, the store of
+    // rd has to be visible before wr is loaded again in poll() as
+    // otherwise the writer may miss to wake the reader.
+    //
+    inline void pop(void)
+    {
+	mbarrier();
+	rd = next;
+	mbarrier();
+    };
+    //
+    // Reader: forget all packets, the caller has to ensure that
+    // no get()/pop() is done at the same time.
+    //
+    inline void flush(void)	{ rd = next = wr; };
+    inline bool poll(int msec)	{ return (rd != wr) || iowatch.Wait(msec); };
+    inline void signal(void)	{ iowatch.Signal(); };
+};
 #endif // __BOUNCE_H
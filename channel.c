@@ -48,16 +48,14 @@ const uint_32 cInStream::PS1magic = 0x000001bd;
 uint_8  * cInStream::tsdata;
 cBounce * cInStream::bounce;
 
-cInStream::cInStream(int Pid, spdif *dev, ctrl_t &up, cBounce *bPtr)
-:cReceiver(tChannelID(), -1, Pid),
- cThread("bso(instream): Forwarding bitstream"),
- ctrl(), wait(), spdifDev(dev), setup(up)
+cInStream::cInStream(int Pid, spdif *dev, ctrl_t &up, cBounce *bPtr, cWorker *forwarder)
+:cReceiver(tChannelID(), -1, Pid), cSession(),
+ stream(NULL), wait(), worker(forwarder), spdifDev(dev), setup(up)
 {
     flags = 0;
-    ctrl.Lock();
-    stream = NULL;
-    ctrl.Unlock();
     Apid = Pid;
+    history = NULL;
+    TScount = 0xff;
     ResetScan();
     bounce = bPtr;
     bounce->bank(0);
@@ -90,63 +88,57 @@ void cInStream::Activate(bool onoff)
 	clear_flag(STREAMING);			// Streaming only after receiving data
 	set_setup(LIVE);
 	bounce->flush();
-	Start();				// Warning: Start() sleeps 10ms after work
+	if (history) {				// Retained packets of this channel
+	    set_flag(ZAPBACK);
+	    (void)history->Replay(this);
+	    clear_flag(ZAPBACK);
+	    history = NULL;
+	}
+	worker->Run(this);			// No new thread for each channel
     } else {
-	int n = 50;				// 500 ms
+	clear_flag(ACTIVE);			// Set only above, stop token of Session()
 
-	clear_flag(ACTIVE);			// Set only above
-	do {
-	    if (bounce) {
-		bounce->flush();
-		bounce->signal();
-	    }
-	    wait.msec(10);			// More than 2ms
-	    if (!Active())
-		break;
-	} while (test_flag(RUNNING) && (n-- > 0));
-	Cancel(1);
-
-	if (test_flag(RUNNING) || Active()) {
-	    esyslog("INSTREAM: Forwarding bitstream thread was broken");
-	    wait.msec(10);			// More than 2ms
-	    ctrl.Lock();
-	    iec60958* curr = stream;
-	    ctrl.Unlock();
-	    if (curr) {				// thread broken
-		spdifDev->Close();
-		clear_flag(BOUNDARY);
-		curr->Reset();
-		if (bounce)
-		    bounce->leaveio();
-	    }
-	    clear_flag(RUNNING);		// Should not happen
+	//
+	// The session uses the stream and the S/P-DIF device, both
+	// must not be reset or freed below it.  Therefore wait on its
+	// end instead of breaking the thread.
+	//
+	if (!worker->Stop(this, 500)) {
+	    esyslog("INSTREAM: Forwarding bitstream thread is late");
+	    (void)worker->Stop(this, -1);
 	}
 
 	ResetScan();
 	clear_setup(LIVE);
 	clear_flag(STREAMING);
-	ctrl.Lock();
-	stream = NULL;
-	ctrl.Unlock();
+	stream.Set(NULL);
     }
 out:
     return;
 }
 
-void cInStream::Action(void)
+//
+// Wake up the forwarding loop below on stop
+//
+void cInStream::Wakeup(void)
+{
+    if (bounce) {
+	bounce->flush();
+	bounce->signal();
+    }
+    StreamReady.Signal();
+}
+
+void cInStream::Session(cThread *caller)
 {
     set_flag(RUNNING);
     iec60958 *curr = NULL;
 
-    realtime("INSTREAM: ");
-
     do {
 	if (!test_flag(ACTIVE))
 	    break;
 	if (StreamReady.Wait(100)) {		// Wait 100ms
-	    ctrl.Lock();
-	    curr = stream;
-	    ctrl.Unlock();
+	    curr = stream.Get();
 	    if (curr) set_flag(STREAMING);	// Ready for streaming
 	}
     } while (!curr);
@@ -159,7 +151,7 @@ void cInStream::Action(void)
 	set_flag(FAILED);
 	goto out;
     } else {
-	if (!spdifDev->Open(curr, this)) {
+	if (!spdifDev->Open(curr, caller)) {
 	    esyslog("INSTREAM: can't open spdif interface");
 	    set_flag(FAILED);
 	    goto out;
@@ -201,13 +193,13 @@ void cInStream::Action(void)
 	if ((len = bounce->fetch(tsdata, spdifDev->Available(TRANSFER_MEM))))
 	    spdifDev->Forward(tsdata, len, bounce);
     }
-    spdifDev->Close(this);
+    spdifDev->Close(caller);
     clear_flag(BOUNDARY);
+    stream.Set(NULL);
+    stream.Synchronize();			// Receive() does not use curr anymore
     curr->Reset();
 out:
-    ctrl.Lock();
-    stream = NULL;
-    ctrl.Unlock();
+    stream.Set(NULL);
     if (bounce) {
 	bounce->flush();
 	bounce->leaveio();
@@ -221,7 +213,6 @@ void cInStream::Receive(uchar *b, int cnt)
     uint_8 *ptr = NULL;
     uint_8 off = 4;
     uint_8 start = 0;
-    static uint_16 skip = 0;
 
     if (test_setup(CLEAR))
 	goto out;
@@ -232,12 +223,6 @@ void cInStream::Receive(uchar *b, int cnt)
 	goto out;
     }
 
-    if (skip) {
-	debug("cReplayOutSPDif::Play(skip=%d)\n", skip);
-	skip--;
-	goto out;
-    }
-
     if (test_setup(MUTE)) {
 	clear_flag(PAYSTART);
 	goto out;
@@ -255,6 +240,48 @@ void cInStream::Receive(uchar *b, int cnt)
 
     start = (b[1] & PAY_START);
 
+    if (Apid != (((uint_16)(b[1]&0x1F)<<8)|b[2]))
+	goto out;
+
+    //
+    // Packets with transport error are forwarded but their payload
+    // is marked as damaged in the bounce buffer.  Their header is not
+    // trusted, therefore such packets can not start a PES frame nor
+    // change the continuity counter.
+    //
+    if (b[1] & TS_ERROR) {
+	if (!test_flag(PAYSTART))
+	    goto out;
+	set_flag(TSERROR);
+	start = 0;
+    } else
+	clear_flag(TSERROR);
+
+    //
+    // Check the continuity counter for lost packets.  On a gap the
+    // rest of the current PES frame is useless, therefore restart
+    // the scanner at the next PES start instead of dropping a fixed
+    // number of packets.  The first byte stored afterwards is marked
+    // as damaged to let the frame scanner conceal the broken frame.
+    //
+    if (!test_flag(TSERROR) && (b[3] & ADAPT_PAYLOAD)) {
+	const uint_8 cc = (b[3] & CONT_CNT_MASK);
+	bool discon = ((b[3] & ADAPT_FIELD) && b[4] && (b[5] & DISCONTINUITY));
+
+	if (TScount <= CONT_CNT_MASK && !discon) {
+	    if (cc == TScount)
+		goto out;			// Duplicate packet
+	    if (cc != ((TScount + 1) & CONT_CNT_MASK)) {
+		debug_chl("%s %d (lost %d packets)\n", __FUNCTION__, __LINE__,
+			  (cc - TScount - 1) & CONT_CNT_MASK);
+		ResetScan();
+		clear_flag(PAYSTART);
+		set_flag(TSLOSS);
+	    }
+	}
+	TScount = cc;
+    }
+
     // Start engine only if PES frame starts
     if (!test_flag(PAYSTART)) {
 	if (!start)
@@ -262,19 +289,6 @@ void cInStream::Receive(uchar *b, int cnt)
 	set_flag(PAYSTART);
     }
 
-    if (Apid != (((uint_16)(b[1]&0x1F)<<8)|b[2]))
-	goto out;
-
-#if 0
-    if (b[1] & TS_ERROR)
-	TSerr++;			// Skip?
-
-    if ((b[3] ^ TScount) & CONT_CNT_MASK) {
-	if (/* TScount != -1 && */ ((b[3] ^ (TScount + 1)) & CONT_CNT_MASK))
-	    TScnterr++;			// Skip?
-	TScount = (b[3] & CONT_CNT_MASK);
-    }
-#endif
     if (b[3] & ADAPT_FIELD) {
 	off += (b[4] + 1);
 	if (off > 187)
@@ -282,13 +296,15 @@ void cInStream::Receive(uchar *b, int cnt)
     }
 
     ptr = &b[off];
-    if (stream == NULL) {		// We edit the buffer contents in this case
+    if (stream.Get() == NULL) {		// We edit the buffer contents in this case
 	ptr = &scan[4];
 	memcpy(ptr, &b[off], TS_SIZE-off);
     }
 
-    if (!ScanTSforAudio(ptr, TS_SIZE-off, (start != 0)))
-	skip = 20;
+    if (!ScanTSforAudio(ptr, TS_SIZE-off, (start != 0))) {
+	ResetScan();				// Bounce buffer is full, resync
+	clear_flag(PAYSTART);			// at the next PES start
+    }
 out:
     return;
 }
@@ -309,9 +325,8 @@ inline bool cInStream::ScanTSforAudio(uint_8 *buf, const int cnt, const bool wak
 {
     const uint_8 *const tail = buf + cnt;
     bool ret = true, search;
-    ctrl.Lock();
-    iec60958 *curr = stream;
-    ctrl.Unlock();
+    cGraceLock Grace(stream);			// Keep curr until we return
+    iec60958 *curr = stream.Get();
 
 resync:
     if (bfound < bytes) {
@@ -624,10 +639,10 @@ resync:
 	//
 	// Set the stream we use and signal the awaiting thread
 	//
-	ctrl.Lock();
-	stream = curr;
-	ctrl.Unlock();
+	stream.Set(curr);
 	StreamReady.Signal(true);
+	if (test_flag(ZAPBACK))			// Thread not started yet, keep
+	    set_flag(STREAMING);		// the retained data in any case
 	clear_flag(WASMUTED);
     } else if (test_flag(WASMUTED)) {
 	if (!test_flag(SET_PTS))
@@ -673,6 +688,7 @@ resync:
     //
     while (bfound < paklen) {
 	register int transmit, pay;
+	size_t bad;
 	bool start;
 
 	if ((transmit = tail - buf) <= 0)
@@ -687,8 +703,11 @@ resync:
 	//
 	start = curr->Count(buf, buf+transmit);
 
-	// Submit data
-	ret  = bounce->store(buf, transmit, start);
+	// Submit data, mark damaged parts
+	bad = test_flag(TSERROR) ? transmit : 0;
+	if (test_and_clear_flag(TSLOSS) && !bad)
+	    bad = 1;
+	ret  = bounce->store(buf, transmit, start, bad);
 	buf += transmit;
     }
 
@@ -717,27 +736,104 @@ void cInStream::Clear(void)
     if (bounce)
 	bounce->flush();
     ResetScan();
+    TScount = 0xff;
+    clear_flag(TSLOSS);
+    clear_flag(TSERROR);
     clear_flag(FAILED);
 }
 
+// --- cZapBack : Retained audio packets of previous channels for fast zap back --------
+
+cZapBack::cZapBack(const cChannel *Channel, int Pid)
+:cReceiver(tChannelID(), -1, Pid),
+ lock(), channel(Channel), Apid(Pid)
+{
+    head = used = 0;
+}
+
+cZapBack::~cZapBack(void)
+{
+    Detach();
+}
+
+void cZapBack::Activate(bool on)
+{
+    lock.Lock();
+    head = used = 0;			// Old data are useless after (de)tuning
+    lock.Unlock();
+}
+
+void cZapBack::Receive(uchar *b, int cnt)
+{
+    if (!b || *b != 0x47 || cnt != TS_SIZE)
+	goto out;
+
+    if (b[1] & TS_ERROR)
+	goto out;
+
+    lock.Lock();
+    memcpy(ring[head], b, TS_SIZE);
+    head = (head + 1) % ZAPBACK_PACKETS;
+    if (used < ZAPBACK_PACKETS)
+	used++;
+    lock.Unlock();
+out:
+    return;
+}
+
+//
+// Forward the retained packets starting with the oldest PES start
+// found in the ring.  The audio of a DVB stream is send well ahead
+// of its PTS, therefore the frames of the last few hundred ms are
+// still in time and the PTS engine drops the late ones.
+//
+int cZapBack::Replay(cInStream *in)
+{
+    bool start = false;
+    int n = 0;
+
+    lock.Lock();
+    uint_16 slot = (head + ZAPBACK_PACKETS - used) % ZAPBACK_PACKETS;
+    for (int i = 0; i < used; i++) {
+	uint_8 *b = ring[slot];
+	slot = (slot + 1) % ZAPBACK_PACKETS;
+	if (!start && !(b[1] & PAY_START))
+	    continue;
+	start = true;
+	in->Receive(b, TS_SIZE);
+	n++;
+    }
+    head = used = 0;
+    lock.Unlock();
+
+    debug_chl("%s %d (%d packets)\n", __FUNCTION__, __LINE__, n);
+    return n;
+}
+
 // --- cChannelOutSPDif : Live AC3 stream over S/P-DIF of a sound card with ALSA ---------
 cBounce * cChannelOutSPDif::bounce;
 const char * cChannelOutSPDif::audioType = audioTypes[IEC_NONE];
 uint_16 cChannelOutSPDif::Apid = 0x1FFF;
 
 cChannelOutSPDif::cChannelOutSPDif(spdif &dev, ctrl_t &up, cBounce * bPtr, const char *script)
-:cStatus(),
- cThread("bso(channelout): Switching bitstream"),
- Channel(NULL), wait(), SPDIFmute(script), spdifDev(&dev), setup(up)
+:cStatus(), cSession(),
+ wantApid(0x1FFF), wantType(NULL), Channel(NULL), wait(),
+ switcher("bso(channelout): Switching bitstream", false),
+ forwarder("bso(instream): Forwarding bitstream"),
+ SPDIFmute(script), spdifDev(&dev), setup(up)
 {
     flags = 0;
     in = NULL;
+    for (int i = 0; i < ZAPBACK_MAX; i++)
+	history[i] = NULL;
     bounce = bPtr;
 }
 
 cChannelOutSPDif::~cChannelOutSPDif(void)
 {
     Clear();
+    switcher.Exit();
+    forwarder.Exit();
 }
 
 bool cChannelOutSPDif::InTransferMode(void)
@@ -772,7 +868,7 @@ out:
 //
 // Stop current attached input filer thread if any and wake up the
 // switching thread if a new audio track was choosen.  The Apid
-// will be determined by GetCurrentAudioTrack() in this thread.
+// is handed over to this thread by Notify().
 //
 void cChannelOutSPDif::SetAudioTrack(int Index, const char * const *Tracks)
 {
@@ -819,11 +915,27 @@ void cChannelOutSPDif::SetAudioTrack(int Index, const char * const *Tracks)
 	    Activate(true);
     }
     sw.Unlock();
+    Notify(apid, type);
+out:
+    return;
+}
+
+//
+// Post an event to the switching thread, the thread does not poll
+// the audio track of the primary device but waits for events.
+// A given apid is the track choosen by the user, without an apid
+// the track is determined by GetCurrentAudioTrack().
+//
+void cChannelOutSPDif::Notify(uint_16 apid, const char *type)
+{
     ctrl.Lock();
+    if (apid && apid < 0x1FFF) {
+	wantApid = apid;
+	wantType = type;
+    }
+    set_flag(PENDING);
     watch.Broadcast();
     ctrl.Unlock();
-out:
-    return;
 }
 
 void cChannelOutSPDif::Activate(bool onoff)
@@ -835,45 +947,44 @@ void cChannelOutSPDif::Activate(bool onoff)
 	if (test_flag(ACTIVE))
 	    goto out;
 	set_flag(ACTIVE);
-	Start();				// Warning: Start() sleeps 10ms after work
+	switcher.Run(this);
     } else {
-	int n = 50;				// 500 ms
-
-	clear_flag(ACTIVE);			// Set only above
-	do {
-	    ctrl.Lock();
-	    watch.Broadcast();
-	    ctrl.Unlock();
-	    pthread_yield();
-	    wait.msec(10);			// More than 2ms
-	    if (!Active())
-		break;
-	} while (test_flag(RUNNING) && (n-- > 0));
-	Cancel(1);
+	clear_flag(ACTIVE);			// Set only above, stop token of Session()
 
-	if (test_flag(RUNNING) || Active()) {
-	    esyslog("CHANNELOUT: Switching bitstream thread broken");
-	    ctrl.Unlock();
-	    clear_flag(RUNNING);		// Should not happen
+	if (!switcher.Stop(this, 500)) {
+	    esyslog("CHANNELOUT: Switching bitstream thread is late");
+	    (void)switcher.Stop(this, -1);
 	}
     }
 out:
     return;
 }
 
-void cChannelOutSPDif::Action(void)
+//
+// Wake up the switching loop below on stop
+//
+void cChannelOutSPDif::Wakeup(void)
+{
+    ctrl.Lock();
+    watch.Broadcast();
+    ctrl.Unlock();
+}
+
+void cChannelOutSPDif::Session(cThread *caller)
 {
     set_flag(RUNNING);
 
     ctrl.Lock();
     while (test_flag(ACTIVE)) {
-	uint_16 apid;
-	const char* type;
-
-	watch.TimedWait(ctrl, 100);			// 100ms
+	uint_16 apid = wantApid;
+	const char* type = wantType;
 
-	if (!test_flag(ACTIVE))
-	    break;
+	if (!test_and_clear_flag(PENDING)) {
+	    watch.Wait(ctrl);				// Sleep until next event
+	    continue;
+	}
+	wantApid = 0x1FFF;
+	wantType = NULL;
 
 	if (test_setup(CLEAR) || !test_setup(ACTIVE))
 	    break;
@@ -881,7 +992,10 @@ void cChannelOutSPDif::Action(void)
 	if (Replaying())
 	    continue;
 
-	if (!GetCurrentAudioTrack(apid, type))		// Get audio pid and type
+	if (apid >= 0x1FFF || !type) {
+	    if (!GetCurrentAudioTrack(apid, type))	// Get audio pid and type
+		continue;
+	} else if (!Channel || InTransferMode())
 	    continue;
 
 	if (Apid == apid)
@@ -926,21 +1040,23 @@ out:
 void cChannelOutSPDif::AudioOff(void)
 {
     sw.Lock();
+    if (in) AttachReceiver(false);	// May retain the current channel
     Channel = NULL;		// Reset Channel
     Apid = 0x1FFF;		// Reset Apid
     audioType = audioTypes[IEC_NONE];	// ... and its type
-    if (in) AttachReceiver(false);
     sw.Unlock();
 }
 
 void cChannelOutSPDif::AttachReceiver(bool onoff)
 {
     cDevice *PrimaryDevice = cDevice::PrimaryDevice();
+    cZapBack *zap = NULL;
 
     if (test_setup(CLEAR))
 	onoff = false;
 
     if (in) {
+	uint_16 apid = in->AudioPid();
 	in->Clear();
 	if (PrimaryDevice)
 	    PrimaryDevice->Detach(in);
@@ -950,6 +1066,7 @@ void cChannelOutSPDif::AttachReceiver(bool onoff)
 	    bounce->flush();
 	Apid = 0x1FFF;
 	audioType = audioTypes[IEC_NONE];
+	Retain(apid);				// Keep for zap back if wanted
     }
 
     if (!onoff)
@@ -961,19 +1078,112 @@ void cChannelOutSPDif::AttachReceiver(bool onoff)
     if (PrimaryDevice->Replaying())
 	goto out;
 
-    in = new cInStream(Apid, spdifDev, setup, bounce);
+    in = new cInStream(Apid, spdifDev, setup, bounce, &forwarder);
     if (!in) {
 	esyslog("ERROR: out of memory");
 	Apid = 0x1FFF;
 	audioType = audioTypes[IEC_NONE];
 	goto out;
     }
+    if ((zap = Retained(Apid)))
+	in->Preload(zap);			// Replayed in cInStream::Activate()
     PrimaryDevice->AttachReceiver(in);
+    in->Preload(NULL);
+    if (zap)
+	delete zap;
 out:
     IfNeededMuteSPDIF();	// On close the S/P-DIF is not muted anymore
     return;
 }
 
+//
+// Keep the audio pid of the channel we leave in a small ring,
+// the oldest retained channel is dropped if all slots are used.
+//
+void cChannelOutSPDif::Retain(uint_16 apid)
+{
+    cDevice *PrimaryDevice = cDevice::PrimaryDevice();
+    const int max = (setup.opt.zapback > ZAPBACK_MAX) ? ZAPBACK_MAX : setup.opt.zapback;
+    cZapBack *zap;
+    int n;
+
+    if (test_setup(CLEAR) || !test_setup(ACTIVE))
+	goto drop;
+
+    if (!PrimaryDevice || PrimaryDevice->Replaying())
+	goto drop;
+
+    if (!Channel || max <= 0 || !apid || apid >= 0x1FFF)
+	goto drop;
+
+    if ((zap = Retained(apid)))			// Refresh an old one
+	delete zap;
+
+    for (n = 0; n < ZAPBACK_MAX && history[n]; n++)
+	;
+    while (n >= max) {				// Forget the oldest one
+	delete history[0];
+	for (int i = 1; i < ZAPBACK_MAX; i++)
+	    history[i-1] = history[i];
+	history[ZAPBACK_MAX-1] = NULL;
+	n--;
+    }
+
+    if (!(zap = new cZapBack(Channel, apid))) {
+	esyslog("ERROR: out of memory");
+	goto out;
+    }
+    if (!PrimaryDevice->AttachReceiver(zap)) {
+	delete zap;
+	goto out;
+    }
+    history[n] = zap;
+out:
+    return;
+drop:
+    DropRetained();
+    return;
+}
+
+//
+// Find and remove a retained channel from the ring, the caller
+// has to delete the returned object.
+//
+cZapBack *cChannelOutSPDif::Retained(uint_16 apid)
+{
+    cZapBack *zap = NULL;
+    int n;
+
+    for (n = 0; n < ZAPBACK_MAX && history[n]; n++) {
+	if (history[n]->Match(Channel, apid)) {
+	    zap = history[n];
+	    break;
+	}
+    }
+    if (!zap)
+	goto out;
+
+    for (; n < ZAPBACK_MAX-1; n++)
+	history[n] = history[n+1];
+    history[ZAPBACK_MAX-1] = NULL;
+
+    if (!zap->IsAttached()) {			// Detached on transponder change
+	delete zap;
+	zap = NULL;
+    }
+out:
+    return zap;
+}
+
+void cChannelOutSPDif::DropRetained(void)
+{
+    for (int n = 0; n < ZAPBACK_MAX; n++) {
+	if (history[n])
+	    delete history[n];
+	history[n] = NULL;
+    }
+}
+
 void cChannelOutSPDif::ChannelSwitch(const cDevice *Device, int channelNumber)
 {
     uint_16 apid;
@@ -1018,6 +1228,11 @@ void cChannelOutSPDif::ChannelSwitch(const cDevice *Device, int channelNumber)
     if (Channel != channel)
 	AudioOff();
 
+    //
+    // A changed PMT of the live channel is noticed by VDR which
+    // retunes the device, therefore this is also the notification
+    // for changed audio pids of the current channel.
+    //
     if (!GetCurrentAudioTrack(apid, type, channel))
 	goto out;
 
@@ -1047,6 +1262,7 @@ void cChannelOutSPDif::Recording(const cDevice *Device, const char *Name, const
     if (On) {
 	Channel = NULL;			// Reset Channel
 	if (in) AttachReceiver(false);
+	DropRetained();			// Do not block the device
     }
 out:
     sw.Unlock();
@@ -1060,8 +1276,11 @@ void cChannelOutSPDif::Replaying(const cControl *Control, const char *Name, cons
     if (On) {
 	Channel = NULL;			// Reset Channel
 	if (in) AttachReceiver(false);
+	DropRetained();
     }
     sw.Unlock();
+    if (!On)
+	Notify();			// Back to live, look for the audio track
     IfNeededMuteSPDIF();		// On close the S/P-DIF is not muted anymore
 }
 
@@ -1184,4 +1403,7 @@ void cChannelOutSPDif::Clear(void)
     if (test_flag(RUNNING))
 	Activate(false);
     AudioOff();
+    sw.Lock();
+    DropRetained();
+    sw.Unlock();
 }
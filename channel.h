@@ -31,6 +31,7 @@
 #include <vdr/dvbdevice.h>
 #include "spdif.h"
 #include "bounce.h"
+#include "worker.h"
 #include "bitstreamout.h"
 #include "iec60958.h"
 
@@ -52,11 +53,22 @@
 #ifndef ADAPT_FIELD
 # define ADAPT_FIELD	0x20
 #endif
+#ifndef ADAPT_PAYLOAD
+# define ADAPT_PAYLOAD	0x10
+#endif
+#ifndef DISCONTINUITY
+# define DISCONTINUITY	0x80
+#endif
 #ifndef PTS_ONLY
 # define PTS_ONLY	0x80
 #endif
 
-class cInStream : public cReceiver, cThread {
+#define ZAPBACK_MAX	4			// Maximal number of retained channels
+#define ZAPBACK_PACKETS	256			// Retained TS packets per channel (~800ms AC3)
+
+class cZapBack;
+
+class cInStream : public cReceiver, cSession {
 private:
     // Bit flags
     volatile flags_t flags;
@@ -69,11 +81,13 @@ private:
     #define FLAG_PAYSTART	5		// The payload of the PES frame
     #define FLAG_PS1AUDIO	6		// We've seen a PS1 PES frame
     #define FLAG_STREAMING	7		// We've set a stream in ScanTSforAudio()
+    #define FLAG_ZAPBACK	9		// Replay of retained packets in Activate()
+    #define FLAG_TSLOSS		10		// Lost TS packets before next payload
+    #define FLAG_TSERROR	11		// Current TS packet has transport error
     // The TS scanner
     static const uint_32 PS1magic;
     // Stream detection
-    iec60958* stream;
-    cMutex ctrl;
+    cPublish<iec60958> stream;			// Read for each TS packet, no lock
     cIoWatch StreamReady;
     const char *audioType;
     uint_32 syncword;
@@ -86,6 +100,7 @@ private:
     uint_16 suboff;
     uint_16 subfnd;
     uint_8  paystart;
+    uint_8  TScount;
     uint_8  pts[5];
     uint_8  scan[TS_SIZE+4];
     #define FLAG_SET_PTS	8		// PTS found in PES frame
@@ -95,20 +110,51 @@ private:
     static uint_8  * tsdata;
     static cBounce * bounce;
     cPsleep wait;
+    cZapBack *history;
+    friend class cZapBack;
+    // Forwarding thread shared by all instances
+    cWorker *const worker;
 protected:
     spdif *const spdifDev;
     ctrl_t &setup;
-    virtual void Action(void);
+    virtual void Session(cThread *caller);
+    virtual void Wakeup(void);
     virtual void Activate(bool on);
     virtual void Receive(uchar *b, int cnt);
 public:
-    cInStream(int Pid, spdif *dev, ctrl_t &up, cBounce * bPtr);
+    cInStream(int Pid, spdif *dev, ctrl_t &up, cBounce * bPtr, cWorker *forwarder);
     ~cInStream();
+    void Preload(cZapBack *zap) { history = zap; };
     uint_16 AudioPid(void) const { return Apid; };
     const char  *AudioType(void) const { return audioType; };
     virtual void Clear(void);
 };
 
+//
+// Keeps the audio TS packets of a previous visited channel
+// in a small ring to be able to start at once on zap back.
+//
+class cZapBack : public cReceiver {
+private:
+    cMutex lock;
+    const cChannel *channel;
+    const uint_16 Apid;
+    uint_16 head;
+    uint_16 used;
+    uint_8  ring[ZAPBACK_PACKETS][TS_SIZE];
+protected:
+    virtual void Activate(bool on);
+    virtual void Receive(uchar *b, int cnt);
+public:
+    cZapBack(const cChannel *Channel, int Pid);
+    ~cZapBack(void);
+    bool Match(const cChannel *Channel, uint_16 apid) const
+    {
+	return (channel == Channel && Apid == apid);
+    };
+    int Replay(cInStream *in);
+};
+
 enum {
     MpegAudio    = false,
     DolbyDigital = true
@@ -121,32 +167,44 @@ public:
     bool UsePid(int Pid) const { return HasPid(Pid); }
 };
 
-class cChannelOutSPDif : public cStatus, cThread {
+class cChannelOutSPDif : public cStatus, cSession {
 private:
     volatile flags_t flags;
     // Sync/Underrun thread
     #define FLAG_RUNNING	0
     #define FLAG_ACTIVE		1
     #define FLAG_SWITCHED	2
+    #define FLAG_PENDING	3
     cInStream *in;
+    cZapBack *history[ZAPBACK_MAX];
     static const char *audioType;
     static uint_16 Apid;
     cMutex sw, ctrl;
     cCondVar watch;
+    uint_16 wantApid;				// Track choosen with SetAudioTrack()
+    const char *wantType;
+    void Notify(uint_16 apid = 0x1FFF, const char *type = NULL);
     const cChannel *Channel;			// Active Live Channel if any
     virtual void IfNeededMuteSPDIF(void);
     static cBounce * bounce;
     cPsleep wait;
+    // Persistent switching and forwarding thread
+    cWorker switcher;
+    cWorker forwarder;
     bool InTransferMode(void);
     bool GetCurrentAudioTrack(uint_16 &apid, const char* &type);
     static bool GetCurrentAudioTrack(uint_16 &apid, const char* &type, const cChannel *channel);
     virtual void AttachReceiver(bool onoff);
+    void Retain(uint_16 apid);
+    cZapBack *Retained(uint_16 apid);
+    void DropRetained(void);
 protected:
     const char *const SPDIFmute;
     spdif *const spdifDev;
     ctrl_t &setup;
     virtual void SetAudioTrack(int Index, const char * const *Tracks);
-    virtual void Action(void);
+    virtual void Session(cThread *caller);
+    virtual void Wakeup(void);
     virtual void Activate(bool on);
     virtual void ChannelSwitch(const cDevice *Device, int ChannelNumber);
     virtual void Recording(const cDevice *Device, const char *Name, const char *FileName, bool On);
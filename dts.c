@@ -206,6 +206,7 @@ inline bool cDTS::crc_check(const uint_8 *const data, const size_t num_bytes)
 //   for a full DTS frame found in the segment.
 const frame_t & cDTS::Frame(const uint_8 *&out, const uint_8 *const tail)
 {
+    const uint_8 *from;
     play.burst = (uint_32 *)0;
     play.size  = 0;
 
@@ -223,11 +224,16 @@ resync:
     // Need the next 5 bytes to decide how big
     // and which mode the frame is
     //
+    from = out;
     while(s.pos < 10) {
 	if (out >= tail)
-	    goto done;
+	    break;
 	payload[s.pos++] = *out++;
     }
+    if (taints && tainted(from, out))
+	s.damaged = true;
+    if (s.pos < 10)
+	goto done;
 
     //
     // Parse and check syncinfo if not known for this frame
@@ -237,6 +243,7 @@ resync:
 	if (!s.syncinfo.frame_size) {
 	    s.syncword = 0xffffffff;
 	    s.pos = 4;
+	    s.damaged = false;
 	    esyslog("DTSPCM: ** Invalid frame found - try to syncing **");
 	    if (out >= tail)
 		goto done;
@@ -252,6 +259,7 @@ resync:
     if (s.syncinfo.burst_size < s.payload_size) {
 	s.syncword = 0xffffffff;
 	s.pos = 4;
+	s.damaged = false;
 	esyslog("DTSPCM: ** Invalid burst size found - try to syncing **");
 	if (out >= tail)
 	    goto done;
@@ -265,6 +273,7 @@ resync:
     if (s.syncinfo.sampling_rate != sample_rate) {
 	s.syncword = 0xffffffff;
 	s.pos = 4;
+	s.damaged = false;
 	esyslog("DTSPCM: ** Invalid sample rate found - try to syncing **");
 	if (out >= tail)
 	    goto done;
@@ -278,10 +287,28 @@ resync:
 	    goto done;
 	if (rest + s.pos > s.payload_size)
 	    rest = s.payload_size - s.pos;
+	if (taints && tainted(out, out + rest))
+	    s.damaged = true;
 	memcpy(&payload[s.pos], out, rest);
 	s.pos += rest;
 	out   += rest;
     }
+
+    //
+    // Known to be damaged by lost or erroneous TS packets, therefore
+    // skip the CRC and conceal with the last frame and error bit set.
+    //
+    if (s.damaged) {
+	s.syncword = 0xffffffff;
+	s.pos = 4;
+	s.payload_size = 0;
+	s.damaged = false;
+	if (!last.burst)
+	    goto resync;
+	dsyslog("DTSPCM: ** Damaged frame - conceal by last frame **");
+	play = conceal();
+	goto done;
+    }
 #if 0
     //
     // Check the crc over the entire frame (which does not
@@ -291,6 +318,7 @@ resync:
     if(!crc_check(payload + 4, s.payload_size - 4)) {
 	s.syncword = 0xffffffff;
 	s.pos = 4;
+	s.damaged = false;
 	s.payload_size = 0;
 #ifdef USE_LAST_FRAME
 	dsyslog("DTSPCM: ** CRC failed - repeat last frame **");
@@ -52,6 +52,7 @@ private:
     struct {
 	size_t    pos;
 	size_t    payload_size;
+	bool      damaged;
 	uint_32   syncword;
 	dtsinfo_t syncinfo;
     } s;
@@ -69,6 +70,7 @@ private:
     inline void reset_scan (void)
     {
 	s.pos = 4;
+	s.damaged = false;
 	s.syncword = 0xffffffff;
 	s.payload_size = 0;
 	memset(&s.syncinfo, 0, sizeof(dtsinfo_t));
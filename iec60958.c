@@ -29,7 +29,9 @@ const char * const audioTypes[5] = {"", "PCM",  "AC3", "DTS", "MP2"};
 iec60958::iec60958(unsigned int rate,
 		   const unsigned int bsize,
 		   const uint_8 poff)
-: burst_size(bsize), offset(poff), start(0), current(0), remember(0), payload(0), flags(0)
+: burst_size(bsize), offset(poff), start(0), stage(0), limit(0), current(0), remember(0), payload(0),
+  flags(0),
+  taints(0)
 {
     sample_rate = rate;
     play.burst = (uint_32 *)0;	// Provide pointer to 16bit PCM stereo samples
@@ -51,14 +53,23 @@ void iec60958::Reset(flags_t arg)
 void iec60958::Clear(void)
 {
     buffer_reset();		// Clear buffer
+    Untaint();			// Forget damaged ranges
     ClassReset();		// E.g. counters, pointers
     pts.reset();		// Timings
 }
 
+void iec60958::Resume(void)
+{
+    buffer_reset();		// Clear buffer
+    Untaint();			// Forget damaged ranges
+    ClassReset();		// E.g. counters, pointers
+    pts.resume();		// Timings, but keep STC sync
+}
+
 const frame_t & iec60958::Frame(enum_frame_t type)
 {
-    uint_16 *sh = (uint_16 *)&remember[0];
-    memset(&remember[0], 0, burst_size);
+    uint_16 *sh = (uint_16 *)&start[0];
+    memset(&start[0], 0, burst_size);
 
     switch (type) {
     default:
@@ -120,6 +131,6 @@ const frame_t & iec60958::Frame(enum_frame_t type)
 	break;
     }
 
-    last.burst = (uint_32 *)&remember[0];
+    last.burst = (uint_32 *)&start[0];
     return last;
 }
@@ -106,19 +106,22 @@ private:
     // the current frame hold in `play'
     //
     uint_8 offset;					// Playload offset from IEC60958 head
-    uint_8 *start;
+    uint_8 *start;					// Special and concealment frames
+    uint_8 *stage;					// Bursts are built one after the
+    uint_8 *limit;					// other within the staging area
     uint_8 *current;
     uint_8 *remember;
     uint_8 *payload;
     inline void buffer_reset(void)
     {
-	current  = start;				// At first adress we start
-	remember = start + SPDIF_BURST_SIZE;		// Remember the last PCM frame
-	payload  = start + offset;			// Pointer to payload of the PCM frame,
+	current  = stage;				// At first adress we start
+	remember = stage;				// Remember the last PCM frame
+	payload  = stage + offset;			// Pointer to payload of the PCM frame,
 							// reserve 4 shorts for lPCM starting head
-	pcm      = (uint_16 *)&start[0];		// Provide access to 16bit PCM samples
+	pcm      = (uint_16 *)&stage[0];		// Provide access to 16bit PCM samples
 
 	memset(start, 0x00, 2*SPDIF_BURST_SIZE);
+	memset(stage, 0x00, SPDIF_BURST_SIZE);
 	play.burst = (uint_32 *)0;
 	play.size  = play.pay =  0;
 	last.burst = (uint_32 *)0;
@@ -131,6 +134,36 @@ private:
     frame_t last;
     uint_16 *pcm;
     flags_t flags;					// Private to the specific class
+    //
+    // Byte ranges of the current input known to be damaged
+    //
+    #define IEC_TAINTS	8
+    const uint_8 *taint[IEC_TAINTS][2];
+    int taints;
+    inline const bool tainted(const uint_8 *from, const uint_8 *to) const
+    {
+	for (int n = 0; n < taints; n++)
+	    if (from < taint[n][1] && to > taint[n][0])
+		return true;
+	return false;
+    };
+    //
+    // Conceal a damaged frame by the last one with error bit set,
+    // the last burst may be still staged for output therefore the
+    // error bit is set within a copy.
+    //
+    inline const frame_t & conceal(void)
+    {
+	uint_8 *const copy = start + SPDIF_BURST_SIZE;
+
+	if (last.burst && (uint_8 *)last.burst != copy) {
+	    memcpy(copy, last.burst, last.size);
+	    last.burst = (uint_32 *)copy;
+	}
+	if (last.burst)
+	    ((uint_16 *)last.burst)[2] |= char2short(0x00, 0x01<<7);
+	return last;
+    };
 public:
     iec60958(unsigned int rate,				// Sample rate
 	     const uint_32 bsize,			// Burst size
@@ -151,23 +184,28 @@ public:
     //
     void Reset(flags_t arg = 0);
     void Clear(void);
+    void Resume(void);
     //
     // This we need to get our external buffer
     //
-    inline void SetBuffer(uint_8 *buf)
+    inline void SetBuffer(uint_8 *buf, uint_8 *area, const size_t len)
     {
 	start = buf;					// Buffer with 2*SPDIF_BURST_SIZE bytes
+	stage = area;					// Staging area of the S/P-DIF output
+	limit = area + len;
 	buffer_reset();
     };
     //
-    // Switch to previous buffer section
-    // if e.g. the current frame is broken
+    // The burst in `play' is complete and becomes the last one,
+    // the next burst is built directly behind it.  If there is no
+    // room for a full burst we wrap around to the staging start.
     //
     inline void Switch(void)
     {
-	uint_8 *tmp = current;
-	current  = remember;
-	remember = tmp;
+	remember = current;
+	current += F2B(B2F(play.size));			// Whole PCM sample frames only
+	if (current + SPDIF_BURST_SIZE > limit)
+	    current = stage;
 	payload  = current + offset;
 	pcm      = (uint_16 *)&current[0];
     };
@@ -192,13 +230,25 @@ public:
     //
     inline const frame_t & Frame(void) const { return last; };
     //
-    // Returns various pcm frames (Pause,Start,Stop,Wait) (buffer is remember[])
+    // Returns various pcm frames (Pause,Start,Stop,Wait) (buffer is start[])
     //
     const frame_t & Frame(enum_frame_t type);
     inline unsigned int BurstSize (void) const { return B2F(burst_size);  };
     inline unsigned int SampleRate(void) const { return sample_rate; };
     inline void SetErr   (void) const { if (pcm) pcm[2] |=  char2short(0x00, 0x01<<7); };
     inline void ClearErr (void) const { if (pcm) pcm[2] &= ~char2short(0x00, 0x01<<7); };
+    //
+    // Mark damaged byte ranges of the input for Frame() above
+    //
+    inline void Taint(const uint_8 *from, const uint_8 *to)
+    {
+	if (taints < IEC_TAINTS) {
+	    taint[taints][0] = from;
+	    taint[taints][1] = to;
+	    taints++;
+	}
+    };
+    inline void Untaint(void) { taints = 0; };
 };
 
 #endif // __IEC60958_H
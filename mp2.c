@@ -25,6 +25,7 @@
 #include "types.h"
 #include "mp2.h"
 #include "shm_memory_tool.h"
+#include "realtime.h"
 
 #define USE_LAST_FRAME		1	// In case of CRC error
 
@@ -35,6 +36,70 @@
 # define debug_mp2(args...)
 #endif
 
+// --- cMP2Decoder : Decode the queued MP2 frames of cMP2 into PCM bursts -------------
+
+cMP2Decoder::cMP2Decoder(cMP2 *owner)
+:cThread("bso(mp2): Decoding MP2 frames"), mp2(owner)
+{
+}
+
+void cMP2Decoder::Action(void)
+{
+    bool open = false;
+    uint_8 epoch = 0;
+
+    rt_thread(RT_DECODER, "MP2: ");
+
+    while (mp2->decoding) {
+	const uint_8 *b;
+	size_t size;
+	uint_8 id;
+	bool lost;
+	int cnt;
+
+	if (!mp2->frames->poll(100))
+	    continue;
+
+	if (!mp2->frames->get(b, cnt, id, lost))
+	    continue;
+
+	if (id != mp2->epoch)			// Frame of a previous stream
+	    goto next;
+
+	if (!open || id != epoch) {
+	    if (open)
+		mp2->Close();
+	    mp2->Open();
+	    open = true;
+	    epoch = id;
+	}
+
+	switch (mp2->Burst(b, cnt, size)) {
+	case MP2_PLAY:
+	    if (size > 0)
+		(void)mp2->bursts->put(mp2->pcmout, size, id);
+	    break;
+	case MP2_LAST:
+#ifdef USE_LAST_FRAME
+	    (void)mp2->bursts->put(mp2->pcmout, 0, id);	// Empty burst: repeat last
+#endif
+	    break;
+	case MP2_ERROR:
+	    esyslog("MP2PCM: ** Error in mad library - try to restart **");
+	    mp2->Close();
+	    open = false;
+	    break;
+	default:
+	    break;
+	}
+    next:
+	mp2->frames->pop();
+    }
+
+    if (open)
+	mp2->Close();
+}
+
 // --- cMP2 : Scanning MP2 stream for counting and decoding into PCM frames ------------
 
 cMP2 mp2(48000);
@@ -58,7 +123,8 @@ const uint_16 cMP2::magic = 0xffe0;
 
 cMP2::cMP2(unsigned int rate)
 : iec60958(rate, MP2_BURST_SIZE, 0),		// 24ms buffer
-running(false)
+running(false), queues(0), frames(NULL), bursts(NULL), decoder(this),
+decoding(false), epoch(0), pcmout(0)
 {
     reset_scan();
     reset_count();
@@ -298,12 +364,10 @@ out:
     return ret;
 }
 
-size_t cMP2::Stream(uint_8 *data, size_t cnt)
+size_t cMP2::Stream(const uint_8 *data, size_t cnt)
 {
     size_t todo = MAD_BUFFER_MDLEN;	// mad.h says: MAD_BUFFER_MDLEN = 511 + 2048 + MAD_BUFFER_GUARD
 
-    if (!running) Start();
-
     if (!BufferGuard()) {
 	//
 	// We always start with a buffer which starts its self with
@@ -358,16 +422,85 @@ out:
     return todo;
 }
 
-void cMP2::Start(void)
+//
+// Decode one MP2 frame with the appended buffer guard into
+// the PCM burst at pcmout, only used by the decoder thread.
+//
+int cMP2::Burst(const uint_8 *data, size_t cnt, size_t &size)
 {
-    if (test_flags(MP2SPDIF)) {
-	Offset(8);			// We use an IEC60958 PCM head
-	return;
+    int status = MP2_ERROR;
+    ssize_t len;
+
+    size = 0;
+    if (Stream(data, cnt) == 0)
+	goto out;
+
+    do {
+	if ((status = Decode()) != MP2_PLAY)
+	    break;
+
+	if ((len = Sample(&pcmout[0], MP2_BURST_SIZE)) < 0) {
+	    status = MP2_ERROR;
+	    break;
+	}
+	size = len;
+
+	if (BufferGuard())			// Do we cross buffer guard line?
+	    break;
+
+    } while (status == MP2_PLAY);
+
+    if (status == MP2_LAST)
+	dsyslog("MP2PCM: ** mad library failed - repeat last frame **");
+out:
+    return status;
+}
+
+//
+// Take the oldest finished PCM burst of the decoder thread,
+// this is all what the S/P-DIF thread does for decoding.
+//
+inline bool cMP2::Pull(void)
+{
+    const uint_8 *b;
+    uint_8 id;
+    bool lost;
+    int len;
+
+    while (bursts->get(b, len, id, lost)) {
+	if (id != epoch || (!len && !last.burst)) {
+	    bursts->pop();			// Previous stream or nothing to repeat
+	    continue;
+	}
+
+	if (!len) {				// Repeat last frame
+	    bursts->pop();
+	    play.burst = last.burst;
+	    play.size  = last.size;
+	    play.pay   = last.pay;
+	    return true;
+	}
+
+	memcpy(&current[0], b, len);
+	bursts->pop();
+
+	play.burst = (uint_32 *)(&current[0]);
+	play.size  = len;
+	play.pay   = len;
+
+	Switch();
+
+	last.burst = (uint_32 *)(&remember[0]);
+	last.size  = play.size;
+	last.pay   = play.pay;
+	return true;
     }
-    if (running) Stop();
-    Offset(0);
+    return false;
+}
+
+void cMP2::Open(void)
+{
     Scale = (test_flags(MP2DITHER)) ? Dither : Round;
-    reset_scan();
     mad_stream_init(&stream);
     mad_stream_options(&stream, (MAD_OPTION_IGNORECRC));
     mad_frame_init (&frame);
@@ -375,16 +508,43 @@ void cMP2::Start(void)
     mad_synth_init (&synth);
     memset(&dith[0], 0, sizeof(dither_t));
     memset(&dith[1], 0, sizeof(dither_t));
-    running = true;
 }
 
-void cMP2::Stop (void)
+void cMP2::Close(void)
 {
     mad_synth_finish (&synth);
     mad_frame_finish (&frame);
     mad_stream_finish(&stream);
+}
+
+void cMP2::Start(void)
+{
+    if (test_flags(MP2SPDIF)) {
+	Offset(8);			// We use an IEC60958 PCM head
+	return;
+    }
+    if (running) Stop();
+    Offset(0);
+    reset_scan();
+    if (!decoding) {
+	decoding = true;
+	decoder.Start();
+    }
+    running = true;
+}
+
+//
+// The decoder thread is kept alive, it restarts libmad with the
+// first frame of the new epoch and drops all frames and bursts
+// of the previous epochs.
+//
+void cMP2::Stop (void)
+{
+    ctr.Lock();
+    epoch++;
     reset_scan();
     running = false;
+    ctr.Unlock();
     if (test_flags(MP2SPDIF))
 	Offset(8);			// We use an IEC60958 PCM head
 }
@@ -394,9 +554,20 @@ const bool cMP2::Initialize(void)
     uint_8 * ptr = (uint_8 *)shm_malloc(MAD_BUFFER_MDLEN + MAD_BUFFER_GUARD);
     if (!ptr)				// mad.h says: MAD_BUFFER_MDLEN = 511 + 2048 + MAD_BUFFER_GUARD
 	return false;
+    uint_8 * mem = (uint_8 *)shm_malloc(MP2_FRAMES_MEM + MP2_BURSTS_MEM + MP2_BURST_SIZE);
+    if (!mem) {
+	shm_free(ptr);
+	return false;
+    }
+    rt_memory(ptr, MAD_BUFFER_MDLEN + MAD_BUFFER_GUARD);
+    rt_memory(mem, MP2_FRAMES_MEM + MP2_BURSTS_MEM + MP2_BURST_SIZE);
     ctr.Lock();
     nextin = ptr;
-    currin = ptr + MAD_BUFFER_GUARD;
+    input.Set(ptr + MAD_BUFFER_GUARD);
+    queues = mem;
+    frames = new cPesQueue(mem, MP2_FRAMES_MEM);
+    bursts = new cPesQueue(mem + MP2_FRAMES_MEM, MP2_BURSTS_MEM);
+    pcmout = mem + MP2_FRAMES_MEM + MP2_BURSTS_MEM;
     ctr.Unlock();
     return true;
 }
@@ -404,11 +575,26 @@ const bool cMP2::Initialize(void)
 const void cMP2::Release(void)
 {
     uint_8 * ptr = nextin;
+    uint_8 * mem = queues;
     if (running) Stop();
+    if (decoding) {
+	decoding = false;
+	frames->signal();
+	decoder.Stop();
+    }
     ctr.Lock();
-    currin = nextin = (uint_8*)0;
+    input.Set((uint_8*)0);
+    input.Synchronize();		// Frame() has left the buffer
+    nextin = (uint_8*)0;
+    if (frames)
+	delete frames;
+    if (bursts)
+	delete bursts;
+    frames = bursts = NULL;
+    queues = pcmout = (uint_8*)0;
     ctr.Unlock();
     shm_free(ptr);
+    shm_free(mem);
 }
 
 // This function requires two arguments:
@@ -416,12 +602,19 @@ const void cMP2::Release(void)
 //   second is the tail of the data segment
 const frame_t & cMP2::Frame(const uint_8 *&out, const uint_8 *const tail)
 {
+    cGraceLock Grace(input);
+    uint_8 *const currin = input.Get();
+
     play.burst = (uint_32 *)0;
     play.size  = 0;
 
-    ctr.Lock();
     if (!currin) goto done;
-newsync:
+pull:
+    if (!test_flags(MP2SPDIF)) {
+	if (!running) Start();
+	if (Pull())					// Finished by the decoder thread
+	    goto done;
+    }
     //
     // Scan the old buffer first which was remembered in
     // the nextin buffer during the last scan at the end.
@@ -618,65 +811,19 @@ resync:
 	    out		  += rest;
 	}
 
-	if (Stream(currin, s.payload_size + s.buffer_gard) == 0) {
-	    s.syncword = 0x001f;				// Error during streaming
-	    s.pos = 2;
-	    s.sample_size = 0;
-	    s.payload_size = 0;
-	    if (out >= tail)
-		goto done;
-	    else
-		goto newsync;					// No goto resync due buffer_gard
-	}
-
-	int status = MP2_PLAY;
-	do {
-	    if ((status = Decode()) != MP2_PLAY)
-		break;
-
-	    s.sample_size = Sample(&current[0], MP2_BURST_SIZE - s.sample_size);
-
-	    if (BufferGuard())					// Do we cross buffer guard line?
-		break;
-
-	} while (status == MP2_PLAY);
-
-	switch (status) {
-	case MP2_LAST:
-	    s.syncword = 0x001f;
-	    s.pos = 2;
-	    s.sample_size = 0;
-	    s.payload_size = 0;
-#ifdef USE_LAST_FRAME
-	    dsyslog("MP2PCM: ** mad library failed - repeat last frame **");
-	    play.burst = last.burst;
-	    play.size  = last.size;
-	    play.pay   = last.pay;
-	    goto done;
-#else
-	    dsyslog("MP2PCM: ** mad library failed - try to syncing **");
-	    if (out >= tail)
-		goto done;
-	    else
-		goto newsync;					// No goto resync due buffer_gard
-#endif
-	case MP2_ERROR:
-	    s.syncword = 0x001f;
-	    s.pos = 2;
-	    s.sample_size = 0;
-	    s.payload_size = 0;
-	    esyslog("MP2PCM: ** Error in mad library - try to restart **");
-	    if (out >= tail)
-		goto done;
-	    else
-		goto newsync;					// No goto resync due buffer_gard
-	default:
-	    break;
-	}
+	//
+	// Hand the frame over to the decoder thread and continue
+	// with the next frame, the PCM burst is pulled above as
+	// soon as it is ready.
+	//
+	if (!frames->put(currin, s.payload_size + s.buffer_gard, epoch))
+	    dsyslog("MP2PCM: ** decoder is too slow - frame dropped **");
 
-	play.burst = (uint_32 *)(&current[0]);
-	play.size  = s.sample_size;
-	play.pay   = s.sample_size;
+	s.syncword = 0x001f;
+	s.pos = 2;
+	s.sample_size = 0;
+	s.payload_size = 0;
+	goto pull;					// No goto resync due buffer_gard
     }
 
     Switch();
@@ -690,7 +837,6 @@ resync:
     s.sample_size = 0;
     s.payload_size = 0;
 done:
-    ctr.Unlock();
     return play;
 }
 
@@ -29,8 +29,17 @@
 #include <mad.h>
 #include "types.h"
 #include "iec60958.h"
+#include "bounce.h"
 #define MP2_BURST_SIZE	192*24
 
+//
+// Queues between the S/P-DIF thread and the decoder thread,
+// MP2 frames with the appended buffer guard in and ready PCM
+// bursts out.  Both are lock free with one reader and one writer.
+//
+#define MP2_FRAMES_MEM	(8*(MAD_BUFFER_MDLEN+MAD_BUFFER_GUARD+8))
+#define MP2_BURSTS_MEM	(6*(MP2_BURST_SIZE+8))
+
 typedef struct _mp2_syncinfo {
     uint_32 sampling_rate;
     int     layer;
@@ -40,7 +49,24 @@ typedef struct _mp2_syncinfo {
     uint_16 burst_size;
 } mp2info_t;
 
+class cMP2;
+
+//
+// Decodes the queued MP2 frames with libmad outside of
+// the realtime thread of the S/P-DIF interface.
+//
+class cMP2Decoder : public cThread {
+private:
+    cMP2 *const mp2;
+protected:
+    virtual void Action(void);
+public:
+    cMP2Decoder(cMP2 *owner);
+    void Stop(void) { Cancel(1); };
+};
+
 class cMP2 : public iec60958 {
+    friend class cMP2Decoder;
 private:
     static const uint_16 magic;
     struct {
@@ -82,11 +108,11 @@ private:
     scale_t Scale;
     inline ssize_t Sample(uint_8 *data, size_t cnt);
     // we use double bouffering ..
-    uint_8* currin;
+    cPublish<uint_8> input;		// Read by Frame() without lock
     uint_8* nextin;
     cMutex  ctr;
     inline  bool BufferGuard(void);
-    size_t  Stream(uint_8 *data, size_t cnt);
+    size_t  Stream(const uint_8 *data, size_t cnt);
 #   define MP2_PLAY	0		// We can play
 #   define MP2_DATA	1		// We need more data
 #   define MP2_LAST	2		// Repeat last frame
@@ -96,6 +122,18 @@ private:
     void    Start (void);
     void    Stop  (void);
     bool    running;
+    // the decoder thread
+    uint_8* queues;
+    cPesQueue *frames;
+    cPesQueue *bursts;
+    cMP2Decoder decoder;
+    volatile bool decoding;		// Decoder thread is running
+    volatile uint_8 epoch;		// Increased on Stop(), older frames and bursts are dropped
+    uint_8* pcmout;			// Used by the decoder thread only
+    void    Open (void);
+    void    Close(void);
+    int     Burst(const uint_8 *data, size_t cnt, size_t &size);
+    inline  bool Pull(void);
     inline void reset_scan (void)
     {
 	s.pos = 2;
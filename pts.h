@@ -243,6 +243,16 @@ public:
 	Synching = false;
 	HasPTS = false;
     };
+    //
+    // Resume after pause or trick mode, the DVB STC clock is
+    // still in sync with the system clock.
+    //
+    inline void  resume(void)
+    {
+	const bool sync = AVsync;
+	reset();
+	AVsync = sync;
+    };
     inline const bool synch(bool s = false)
     {
 	if (s) Synching = true;
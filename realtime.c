@@ -0,0 +1,365 @@
+/*
+ * realtime.c:	Scheduling, CPU affinity, and memory locking of the
+ *		threads of the plugin
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ * Copyright (C) 2005 Werner Fink, <werner@suse.de>
+ */
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <vdr/tools.h>
+#include "realtime.h"
+
+#ifndef SCHED_DEADLINE
+# define SCHED_DEADLINE		6
+#endif
+#ifndef SCHED_RESET_ON_FORK
+# define SCHED_RESET_ON_FORK	0x40000000
+#endif
+#define SCHED_FLAG_RESET	0x01		// SCHED_RESET_ON_FORK for sched_setattr(2)
+
+//
+// Argument of sched_setattr(2), not provided by older C libraries
+//
+typedef struct _rtattr {
+    uint_32 size;
+    uint_32 sched_policy;
+    uint_64 sched_flags;
+    sint_32 sched_nice;
+    uint_32 sched_priority;
+    uint_64 sched_runtime;
+    uint_64 sched_deadline;
+    uint_64 sched_period;
+} rtattr_t;
+
+typedef struct _rtconf {
+    int policy;				// -1 leaves the policy of VDR
+    int priority;			// Zero is 4/5 of the maximum
+    int nice;
+    uint_64 runtime;			// SCHED_DEADLINE in nano seconds
+    uint_64 period;
+    bool affinity;
+    bool given;				// Set on the command line
+    cpu_set_t cpus;
+} rtconf_t;
+
+static const char *const classes[RT_CLASSES] = { "output", "receiver", "decoder" };
+
+static const struct {
+    const char *name;
+    int policy;
+} policies[] = {
+    { "other",    SCHED_OTHER    },
+    { "fifo",     SCHED_FIFO     },
+    { "rr",       SCHED_RR       },
+    { "deadline", SCHED_DEADLINE },
+};
+
+//
+// Without any option only the forwarding threads are raised
+// as done all the time.
+//
+static rtconf_t rtconf[RT_CLASSES];
+static int rtlock = RT_LOCK_NONE;
+
+static class cRtInit {
+public:
+    cRtInit(void)
+    {
+	for (int cls = 0; cls < RT_CLASSES; cls++) {
+	    memset(&rtconf[cls], 0, sizeof(rtconf_t));
+	    rtconf[cls].policy = -1;
+	}
+#ifndef DEBUG
+	rtconf[RT_OUTPUT].policy = SCHED_RR;
+	rtconf[RT_OUTPUT].nice = -15;
+#endif
+    }
+} rtinit;
+
+#define report(conf, format, args...)	\
+    do { if ((conf)->given) esyslog(format, ## args); else dsyslog(format, ## args); } while (0)
+
+//
+// Without root the limits RLIMIT_RTPRIO and RLIMIT_NICE tell how
+// far a thread may be raised, e.g. set by limits.conf(5) for the
+// audio group.  The soft limit is raised to the hard limit first.
+// Returns -1 if there is no limit.
+//
+static long rtlimit(const int resource)
+{
+    struct rlimit rl;
+
+    if (geteuid() == 0)
+	goto unlimited;
+    if (getrlimit(resource, &rl) < 0)
+	goto unlimited;
+    if (rl.rlim_cur != rl.rlim_max) {
+	rl.rlim_cur = rl.rlim_max;
+	(void)setrlimit(resource, &rl);
+	(void)getrlimit(resource, &rl);
+    }
+    if (rl.rlim_cur == RLIM_INFINITY)
+	goto unlimited;
+    return (long)rl.rlim_cur;
+unlimited:
+    return -1;
+}
+
+static bool cpulist(const char *ptr, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    do {
+	unsigned long from, to;
+	char *end;
+
+	from = to = strtoul(ptr, &end, 10);
+	if (end == ptr)
+	    goto err;
+	if (*end == '-') {
+	    ptr = end + 1;
+	    to = strtoul(ptr, &end, 10);
+	    if (end == ptr || to < from)
+		goto err;
+	}
+	if (to >= CPU_SETSIZE)
+	    goto err;
+	while (from <= to)
+	    CPU_SET(from++, set);
+	ptr = end;
+    } while (*ptr++ == ',');
+    return (*(ptr - 1) == '\0');
+err:
+    return false;
+}
+
+bool rt_parse(const char *arg)
+{
+    const char *ptr;
+    char *end;
+    rtconf_t conf;
+    size_t len = 0;
+    int cls;
+
+    for (cls = 0; cls < RT_CLASSES; cls++) {
+	len = strlen(classes[cls]);
+	if (!strncasecmp(arg, classes[cls], len) && (arg[len] == '=' || arg[len] == '@'))
+	    break;
+    }
+    if (cls >= RT_CLASSES)
+	goto err;
+
+    conf = rtconf[cls];
+    conf.given = true;
+    ptr = arg + len;
+
+    if (*ptr == '=') {
+	unsigned int n;
+	long val;
+
+	ptr++;
+	len = strcspn(ptr, ":@");
+	for (n = 0; n < sizeof(policies)/sizeof(*policies); n++)
+	    if (strlen(policies[n].name) == len && !strncasecmp(ptr, policies[n].name, len))
+		break;
+	if (n >= sizeof(policies)/sizeof(*policies))
+	    goto err;
+	conf.policy = policies[n].policy;
+	conf.priority = conf.nice = 0;
+	conf.runtime = conf.period = 0;
+	ptr += len;
+
+	if (*ptr == ':') {
+	    val = strtol(++ptr, &end, 10);
+	    if (end == ptr)
+		goto err;
+	    switch (conf.policy) {
+	    case SCHED_OTHER:
+		if (val < -20 || val > 19)
+		    goto err;
+		conf.nice = val;
+		break;
+	    case SCHED_DEADLINE:
+		if (*end != '/' || val <= 0)
+		    goto err;
+		conf.runtime = (uint_64)val * 1000;
+		ptr = end + 1;
+		val = strtol(ptr, &end, 10);
+		if (end == ptr || (uint_64)val * 1000 < conf.runtime)
+		    goto err;
+		conf.period = (uint_64)val * 1000;
+		break;
+	    default:
+		if (val < sched_get_priority_min(conf.policy) || val > sched_get_priority_max(conf.policy))
+		    goto err;
+		conf.priority = val;
+		break;
+	    }
+	    ptr = end;
+	} else if (conf.policy == SCHED_DEADLINE)
+	    goto err;				// Runtime and period are required
+    }
+
+    if (*ptr == '@') {
+	if (!cpulist(ptr + 1, &conf.cpus))
+	    goto err;
+	conf.affinity = true;
+	ptr += strlen(ptr);
+    }
+    if (*ptr)
+	goto err;
+
+    rtconf[cls] = conf;
+    return true;
+err:
+    esyslog("ERROR: wrong realtime policy `%s'", arg);
+    return false;
+}
+
+bool rt_memlock(const char *arg)
+{
+    if (!arg || !strcasecmp(arg, "buffer"))
+	rtlock = RT_LOCK_BUFFER;
+    else if (!strcasecmp(arg, "all"))
+	rtlock = RT_LOCK_ALL;
+    else {
+	esyslog("ERROR: wrong memory locking `%s'", arg);
+	return false;
+    }
+    return true;
+}
+
+void rt_lock(void)
+{
+    if (rtlock != RT_LOCK_ALL)
+	return;
+    if (mlockall(MCL_CURRENT|MCL_FUTURE) < 0)
+	esyslog("Can not lock memory of the process: %s", strerror(errno));
+}
+
+void rt_memory(void *buf, size_t len)
+{
+    volatile uint_8 *const mem = (volatile uint_8 *)buf;
+    const size_t page = sysconf(_SC_PAGESIZE);
+
+    if (rtlock == RT_LOCK_NONE || !buf)
+	goto out;
+    if (rtlock == RT_LOCK_BUFFER && mlock(buf, len) < 0)
+	esyslog("Can not lock buffer memory: %s", strerror(errno));
+
+    for (size_t n = 0; n < len; n += page)	// Prefault even if not locked
+	mem[n] = mem[n];
+out:
+    return;
+}
+
+//
+// Touch the stack to have it mapped before the first burst
+//
+static void __attribute__((noinline)) prefault(void)
+{
+    volatile uint_8 stack[RT_STACK_FAULT];
+    const size_t page = sysconf(_SC_PAGESIZE);
+
+    for (size_t n = 0; n < sizeof(stack); n += page)
+	stack[n] = 0;
+}
+
+void rt_thread(const int cls, const char *name)
+{
+    const rtconf_t *const conf = &rtconf[cls];
+    struct sched_param param;
+    rtattr_t attr;
+    long limit;
+    int nice;
+
+    if (conf->affinity && sched_setaffinity(0, sizeof(cpu_set_t), &conf->cpus) < 0)
+	esyslog("%sthread can not set CPU affinity: %s", name, strerror(errno));
+
+    //
+    // The policy is not inherited by children, e.g. the mute script
+    //
+    switch (conf->policy) {
+    case SCHED_FIFO:
+    case SCHED_RR:
+	param.sched_priority = conf->priority;
+	if (!param.sched_priority)
+	    param.sched_priority = (sched_get_priority_max(conf->policy)*4)/5;
+	if ((limit = rtlimit(RLIMIT_RTPRIO)) >= 0 && param.sched_priority > limit)
+	    param.sched_priority = limit;
+	if (param.sched_priority <= 0) {
+	    report(conf, "%sthread can not set scheduling priority: not allowed by RLIMIT_RTPRIO", name);
+	    break;
+	}
+	if (sched_setscheduler(0, conf->policy|SCHED_RESET_ON_FORK, &param) < 0)
+	    report(conf, "%sthread can not set scheduling priority: %s", name, strerror(errno));
+	break;
+    case SCHED_DEADLINE:
+	memset(&attr, 0, sizeof(rtattr_t));
+	attr.size = sizeof(rtattr_t);
+	attr.sched_policy = SCHED_DEADLINE;
+	attr.sched_flags = SCHED_FLAG_RESET;
+	attr.sched_runtime = conf->runtime;
+	attr.sched_deadline = conf->period;
+	attr.sched_period = conf->period;
+#ifdef __NR_sched_setattr
+	if (syscall(__NR_sched_setattr, 0, &attr, 0) < 0)
+#else
+	errno = ENOSYS;
+#endif
+	    report(conf, "%sthread can not set deadline scheduling: %s", name, strerror(errno));
+	break;
+    case SCHED_OTHER:
+	param.sched_priority = 0;
+	if (sched_setscheduler(0, SCHED_OTHER, &param) < 0)
+	    report(conf, "%sthread can not set scheduling policy: %s", name, strerror(errno));
+	break;
+    default:
+	break;
+    }
+
+    //
+    // RLIMIT_NICE allows a nice level down to 20 - limit, if this
+    // is not below the current level there is nothing to raise.
+    //
+    if ((nice = conf->nice)) {
+	if ((limit = rtlimit(RLIMIT_NICE)) >= 0 && nice < 20 - limit) {
+	    int now;
+
+	    errno = 0;
+	    now = getpriority(PRIO_PROCESS, 0);
+	    if (errno || 20 - limit >= now) {
+		report(conf, "%sthread can not set process priority: not allowed by RLIMIT_NICE", name);
+		goto out;
+	    }
+	    nice = 20 - limit;
+	}
+	if (setpriority(PRIO_PROCESS, 0, nice) < 0)	// Only this thread
+	    report(conf, "%sthread can not set process priority: %s", name, strerror(errno));
+    }
+
+out:
+    if (rtlock != RT_LOCK_NONE)
+	prefault();
+}
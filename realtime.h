@@ -0,0 +1,76 @@
+/*
+ * realtime.h:	Scheduling, CPU affinity, and memory locking of the
+ *		threads of the plugin
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ * Copyright (C) 2005 Werner Fink, <werner@suse.de>
+ */
+
+#ifndef __REALTIME_H
+#define __REALTIME_H
+
+#include <sys/types.h>
+#include "types.h"
+
+//
+// Classes of threads, each with its own policy
+//
+#define RT_OUTPUT	0		// Forwarding threads to the S/P-DIF
+#define RT_RECEIVER	1		// Parser thread of the received PES packets
+#define RT_DECODER	2		// MP2 decoder thread
+#define RT_CLASSES	3
+
+//
+// Memory locking
+//
+#define RT_LOCK_NONE	0
+#define RT_LOCK_BUFFER	1		// Shared memory buffers and thread stacks
+#define RT_LOCK_ALL	2		// Whole process with mlockall(2)
+
+#define RT_STACK_FAULT	(64*1024)	// Prefaulted stack of a thread
+
+//
+// Parse one policy given on the command line:
+//
+//   class=policy[:priority][@cpus]
+//
+// with the class output, receiver, or decoder, and the policy
+// other, fifo, rr, or deadline.  The priority is the nice level
+// for other and the realtime priority for fifo and rr.  For
+// deadline it is runtime/period in micro seconds.  The cpus are
+// a list like 2,3 or 2-3.  Returns false on syntax errors.
+//
+extern bool rt_parse(const char *arg);
+//
+// Parse the memory locking, either buffer or all
+//
+extern bool rt_memlock(const char *arg);
+//
+// Lock the whole process if requested, called once at start
+//
+extern void rt_lock(void);
+//
+// Lock and prefault a shared memory buffer if requested
+//
+extern void rt_memory(void *buf, size_t len);
+//
+// Apply the policy of the class to the calling thread, the
+// name is used for messages.
+//
+extern void rt_thread(const int cls, const char *name);
+
+#endif // __REALTIME_H
@@ -25,6 +25,7 @@
 #define _GNU_SOURCE
 #endif
 #include <stdio.h>
+#include <time.h>
 #include "types.h"
 #include "bytes.h"
 #include "replay.h"
@@ -33,6 +34,76 @@
 #include "dts.h"
 #include "lpcm.h"
 #include "mp2.h"
+#include "realtime.h"
+
+// --- cPesParser : Parse the queued PES packets of cReplayOutSPDif ------------------------
+
+cPesParser::cPesParser(cReplayOutSPDif *owner)
+:cThread("bso(replay): Parsing PES packets"), replay(owner),
+ mutex(), done(), running(false)
+{
+}
+
+void cPesParser::Run(void)
+{
+    mutex.Lock();
+    running = true;
+    mutex.Unlock();
+    if (!Start()) {
+	mutex.Lock();
+	running = false;
+	mutex.Unlock();
+	esyslog("REPLAY: can not start parsing PES packets thread");
+    }
+}
+
+//
+// Joined just like cWorker::Exit(), the thread is never cancelled
+// as replay and queue are used up to the end of Action().
+//
+void cPesParser::Stop(void)
+{
+    const struct timespec tick = { 0, 1000000 };
+
+    mutex.Lock();
+    replay->queue.signal();			// Leave poll() at once
+    if (running && !done.TimedWait(mutex, 1000))
+	esyslog("REPLAY: Parsing PES packets thread is late");
+    while (running)
+	done.Wait(mutex);
+    mutex.Unlock();
+    while (Active())				// Leaves Action() at once
+	nanosleep(&tick, NULL);
+}
+
+void cPesParser::Action(void)
+{
+    rt_thread(RT_RECEIVER, "PARSER: ");
+
+    while (test_bit(FLAG_PARSER, &replay->flags)) {
+	const uint_8 *b;
+	uint_8 id;
+	bool lost;
+	int cnt;
+
+	if (!replay->queue.poll(100))
+	    continue;
+
+	replay->parse.Lock();
+	if (replay->queue.get(b, cnt, id, lost)) {
+	    if (lost)				// Queue was full, continue
+		set_bit(FLAG_RESYNC, &replay->flags);	// at next aligned PES
+	    replay->Parse(b, cnt, id);
+	    replay->queue.pop();
+	}
+	replay->parse.Unlock();
+    }
+
+    mutex.Lock();
+    running = false;
+    done.Broadcast();
+    mutex.Unlock();
+}
 
 // --- cReplayOutSPDif : Forward AC3 stream to S/P-DIF of a sound card with ALSA -----------
 
@@ -43,13 +114,12 @@ uint_8  * cReplayOutSPDif::pesdata;
 cBounce * cReplayOutSPDif::bounce;
 
 cReplayOutSPDif::cReplayOutSPDif(spdif &dev, ctrl_t &up, cBounce * bPtr, const char *script)
-:cAudio(), cThread("bso(replay): Forwarding bitstream"),
- ctr(), wait(), SPDIFmute(script), spdifDev(&dev), setup(up)
+:cAudio(), cSession(),
+ stream(NULL), wait(), queue(up.buf + PESQUEUE_START, PESQUEUE_MEM), parser(this), parse(),
+ worker("bso(replay): Forwarding bitstream"),
+ SPDIFmute(script), spdifDev(&dev), setup(up)
 {
     flags = 0;
-    ctr.Lock();
-    stream = NULL;
-    ctr.Unlock();
     bounce = bPtr;
     bounce->bank(0);
     pesdata = setup.buf + TRANSFER_START;
@@ -57,7 +127,10 @@ cReplayOutSPDif::cReplayOutSPDif(spdif &dev, ctrl_t &up, cBounce * bPtr, const c
 
 cReplayOutSPDif::~cReplayOutSPDif(void)
 {
-    Clear();
+    if (test_and_clear_flag(PARSER))
+	parser.Stop();
+    ClearStream();
+    worker.Exit();
 }
 
 void cReplayOutSPDif::Activate(bool onoff)
@@ -80,65 +153,48 @@ void cReplayOutSPDif::Activate(bool onoff)
 	}
 	set_flag(ACTIVE);
 	bounce->flush();
-	Start();				// Warning: Start() sleeps 10ms after work
+	worker.Run(this);			// No new thread for each replay
 	debug("Activated\n");
     } else {
-	int n = 50;				// 500 ms
+	clear_flag(ACTIVE);			// Set only above, stop token of Session()
 
-	clear_flag(ACTIVE);			// Set only above
-	do {
-	    if (bounce) {
-		bounce->flush();
-		bounce->signal();
-	    }
-	    wait.msec(10);			// More than 2ms
-	    if (!Active())
-		break;
-	} while (test_flag(RUNNING) && (n-- > 0));
-	Cancel(1);
-
-	if (test_flag(RUNNING) || Active()) {
-	    esyslog("REPLAY: Forwarding bitstream thread was broken");
-	    wait.msec(10);			// More than 2ms
-	    ctr.Lock();
-	    iec60958* curr = stream;
-	    ctr.Unlock();
-	    if (curr) {				// thread broken
-		spdifDev->Close();
-		clear_flag(BOUNDARY);
-		curr->Reset();
-		if (bounce)
-		    bounce->leaveio();
-            }
-	    clear_flag(RUNNING);		// Should not happen
+	if (!worker.Stop(this, 500)) {
+	    esyslog("REPLAY: Forwarding bitstream thread is late");
+	    (void)worker.Stop(this, -1);	// Do not reset the stream below it
 	}
 
-	ctr.Lock();
-	stream = NULL;
-	ctr.Unlock();
+	stream.Set(NULL);
 	debug("DeActivated\n");
     }
 out:
     return;
 }
 
-void cReplayOutSPDif::Action(void)
+//
+// Wake up the forwarding loop below on stop
+//
+void cReplayOutSPDif::Wakeup(void)
+{
+    if (bounce) {
+	bounce->flush();
+	bounce->signal();
+    }
+}
+
+void cReplayOutSPDif::Session(cThread *caller)
 {
     if (test_setup(CLEAR))
 	return;
 
     set_flag(RUNNING);
-    ctr.Lock();
-    iec60958 *curr = stream;
-    ctr.Unlock();
+    iec60958 *curr = stream.Get();
 
-    realtime("REPLAY: ");
     if (!curr) {
 	esyslog("REPLAY: no stream for spdif interface");
 	set_flag(FAILED);
 	goto out;
     } else {
-        if (!spdifDev->Open(curr, this)) {
+        if (!spdifDev->Open(curr, caller)) {
 	    esyslog("REPLAY: can't open spdif interface");
 	    set_flag(FAILED);
 	    goto out;
@@ -154,7 +210,7 @@ void cReplayOutSPDif::Action(void)
 		spdifDev->Clear();
 		clear_flag(BOUNDARY);
 		bounce->flush();
-		curr->Clear();
+		curr->Resume();
 	    }
 	    set_flag(WASMUTED);
 	}
@@ -165,12 +221,15 @@ void cReplayOutSPDif::Action(void)
 	if (!test_flag(ACTIVE))
 	    break;
 
+	if (test_and_clear_flag(TRICK))		// Set by Clear() in trick mode
+	    spdifDev->Clear();			// drop the queued bursts only
+
 	if (test_setup(MUTE)) {
 	    if (!test_flag(WASMUTED)) {
 		spdifDev->Clear();
 		clear_flag(BOUNDARY);
 		bounce->flush();
-		curr->Clear();
+		curr->Resume();
 	    }
 	    set_flag(WASMUTED);
 	    continue;
@@ -180,13 +239,11 @@ void cReplayOutSPDif::Action(void)
 	    spdifDev->Forward(pesdata, len, bounce);
 
     }
-    spdifDev->Close(this);
+    spdifDev->Close(caller);
     clear_flag(BOUNDARY);
     curr->Reset();
 out:
-    ctr.Lock();
-    stream = NULL;
-    ctr.Unlock();
+    stream.Set(NULL);
     if (bounce) {
 	bounce->flush();
 	bounce->leaveio();
@@ -200,9 +257,7 @@ inline bool cReplayOutSPDif::OffsetToDvdOfPS1(const uchar *const b, int &off, co
     const off_t rest = cnt-off;
     bool ret = false;				// DVB streams do not have sub stream headers
     cHandle dvd(&b[off], rest);
-    ctr.Lock();
-    iec60958* curr = stream;
-    ctr.Unlock();
+    iec60958* curr = stream.Get();
 
     TEST(dvd >= (size_t)4) {
 	uint_32 ul = dvd;
@@ -278,9 +333,7 @@ inline bool cReplayOutSPDif::ScanPayOfPS1(const uchar *const b, int &off, const
 {
     const off_t rest = cnt-off;
     cHandle dvb(&b[off], rest);
-    ctr.Lock();
-    iec60958* curr = stream;
-    ctr.Unlock();
+    iec60958* curr = stream.Get();
 
     if (curr)
 	goto out;
@@ -419,9 +472,7 @@ inline bool cReplayOutSPDif::ScanPayOfPS1(const uchar *const b, int &off, const
     } END (dvb);
 
 out:
-    ctr.Lock();
-    stream = curr;
-    ctr.Unlock();
+    stream.Set(curr);
     return (curr != NULL);
 }
 
@@ -430,9 +481,7 @@ inline bool cReplayOutSPDif::DigestPayOfMP2(const uchar *const b, int &off, cons
     static const uint_32 samplerate_table[3] = {44100, 48000, 32000};
     const off_t rest = cnt-off;
     cHandle audio(&b[off], rest);
-    ctr.Lock();
-    iec60958* curr = stream;
-    ctr.Unlock();
+    iec60958* curr = stream.Get();
 
     FOREACH(audio >= (size_t)2) {
 	uint_16 us = audio;
@@ -483,21 +532,16 @@ inline bool cReplayOutSPDif::DigestPayOfMP2(const uchar *const b, int &off, cons
 
     } END (handle);
 
-    ctr.Lock();
-    stream = curr;
-    ctr.Unlock();
+    stream.Set(curr);
     return (curr != NULL);
 }
 
+//
+// Called by the player thread of VDR, therefore only queue the
+// PES packet for the parser thread and return immediately.
+//
 void cReplayOutSPDif::Play(const uchar *b, int cnt, uchar id)
 {
-    static uint_16 skip = 0;
-    cHandle play(b, cnt);
-    bool pts = false;
-    ctr.Lock();
-    iec60958* curr = stream;
-    ctr.Unlock();
-
     if (test_setup(CLEAR))
 	goto out;
 
@@ -507,9 +551,29 @@ void cReplayOutSPDif::Play(const uchar *b, int cnt, uchar id)
 	goto out;
     }
 
-    if (skip) {
-	debug("cReplayOutSPDif::Receive(skip=%d)\n", skip);
-	skip--;
+    if (test_setup(MUTE) || test_setup(LIVE))
+	goto out;
+
+    if (!test_and_set_flag(PARSER))
+	parser.Run();
+
+    (void)queue.put(b, cnt, id);
+out:
+    return;
+}
+
+void cReplayOutSPDif::Parse(const uchar *b, int cnt, uchar id)
+{
+    cHandle play(b, cnt);
+    bool pts = false;
+    iec60958* curr = stream.Get();
+
+    if (test_setup(CLEAR))
+	goto out;
+
+    if (!test_setup(ACTIVE)) {
+	if (test_flag(ACTIVE))
+	    ClearStream();
 	goto out;
     }
 
@@ -532,11 +596,17 @@ void cReplayOutSPDif::Play(const uchar *b, int cnt, uchar id)
 
 	pts = ((flg & 0x0080) && (off >= (9+5)));
 
+	if (test_flag(RESYNC)) {		// Continue only at the next
+	    if (!(flg & 0x00C0) && !(flg & 0x0400))
+		goto out;			// aligned PES frame or at the
+	    clear_flag(RESYNC);			// next Present Time Stamp
+	}
+
 	switch (mag) {
 	case PS1magic:				// Audio of PES Private Stream 1
 
 	    if (curr == &mp2) {			// MP2 already active
-		Clear();			// Reset
+		ClearStream();			// Reset
 		goto out;
 	    }
 
@@ -552,9 +622,7 @@ void cReplayOutSPDif::Play(const uchar *b, int cnt, uchar id)
 		    if (!ScanPayOfPS1(&b[0], off, cnt, id))
 			goto out;
 		    
-		    ctr.Lock();
-		    curr = stream;
-		    ctr.Unlock();
+		    curr = stream.Get();
 		    if (!curr) goto out;	// Paranoid
 
 		    set_flag(BOUNDARY);		// At the beginning of a stream
@@ -578,13 +646,13 @@ void cReplayOutSPDif::Play(const uchar *b, int cnt, uchar id)
 		if (curr->isDVD) {
 		    // Check if DVD stream is still valid
 		    if (!OffsetToDvdOfPS1(b, off, cnt, id)) {
-			Clear();		// Reset
+			ClearStream();		// Reset
 			goto out;
 		    }
 		} else {
 		    // Check if id of the stream is still valid
 		    if (id != 0xBD) {
-			Clear();		// Reset
+			ClearStream();		// Reset
 			goto out;
 		    }
 		}
@@ -598,11 +666,11 @@ void cReplayOutSPDif::Play(const uchar *b, int cnt, uchar id)
 		uint_8 track = ((uint_8)(mag & 0xFF) - 0xC0) + 1;
 
 		if (curr != &mp2) {		// PS1 already active
-		    Clear();			// Reset
+		    ClearStream();			// Reset
 		    goto out;
 		}
 		if (curr->track != track) {	// Wrong track
-		    Clear();			// Reset
+		    ClearStream();			// Reset
 		    goto out;
 		}
 	    }
@@ -616,9 +684,7 @@ void cReplayOutSPDif::Play(const uchar *b, int cnt, uchar id)
 	    if (!DigestPayOfMP2(&b[0], off, cnt, id))
 		goto out;
 
-	    ctr.Lock();
-	    curr = stream;
-	    ctr.Unlock();
+	    curr = stream.Get();
 	    if (!curr) goto out;		// Paranoid
 
 	    set_flag(BOUNDARY);			// At the beginning of a stream
@@ -666,7 +732,7 @@ void cReplayOutSPDif::Play(const uchar *b, int cnt, uchar id)
 	    }
 
 	    if (!bounce->store(buf, transmit, start))
-		skip = 2;
+		set_flag(RESYNC);		// Bounce buffer is full
 
 	}
 
@@ -678,23 +744,18 @@ out:
 void cReplayOutSPDif::Mute(bool onoff)
 {
     debug("cReplayOutSPDif::Mute(%d) called\n", onoff);
+    cMutexLock MutexLock(&parse);		// Not within Parse()
     if ((test_setup(MUTE) ? true : false) == onoff)
 	goto out;
 
-    clear_setup(STILLPIC);
     if (onoff) {
-	cDevice *PrimaryDevice = cDevice::PrimaryDevice();
-	LOCK_THREAD;
-	ctr.Lock();
-	iec60958* curr = stream;
-	ctr.Unlock();
+	cThreadLock ThreadLock(&worker);
+	iec60958* curr = stream.Get();
 
 	set_setup(MUTE);
-	if (PrimaryDevice && !PrimaryDevice->IsMute())
-	    set_setup(STILLPIC);
 	spdifDev->Pause(onoff);
 	if (curr)
-	    curr->Clear();
+	    curr->Resume();
 	bounce->flush();
 	bounce->signal();
 	clear_flag(BOUNDARY);
@@ -721,18 +782,38 @@ out:
 }
 
 void cReplayOutSPDif::Clear(void)
+{
+    debug("cReplayOutSPDif::Clear() called\n");
+    parse.Lock();				// Not within Parse()
+    queue.flush();
+    iec60958* curr = stream.Get();
+    if (curr && test_flag(RUNNING) && test_setup(ACTIVE) && !test_setup(CLEAR)) {
+	//
+	// Pause, trick mode or jump within the replay: keep the forwarding
+	// thread and the S/P-DIF open and drop only the queued bursts, the
+	// stream resumes at the first frame with the new PTS.
+	//
+	cThreadLock ThreadLock(&worker);
+	curr->Resume();
+	bounce->flush();
+	clear_flag(BOUNDARY);
+	set_flag(RESYNC);
+	set_flag(TRICK);
+	bounce->signal();
+    } else
+	ClearStream();
+    parse.Unlock();
+}
+
+void cReplayOutSPDif::ClearStream(void)
 {
     cDevice *PrimaryDevice = cDevice::PrimaryDevice();
 
-    debug("cReplayOutSPDif::Clear() called\n");
     if (test_flag(RUNNING))
 	Activate(false);
-    ctr.Lock();
-    iec60958* curr = stream;
-    stream = NULL;
-    ctr.Unlock();
+    iec60958* curr = stream.Swap(NULL);
     if (curr) {
-	LOCK_THREAD;
+	cThreadLock ThreadLock(&worker);
 	curr->Reset();
 	if (bounce) {
 	    bounce->flush();
@@ -740,7 +821,8 @@ void cReplayOutSPDif::Clear(void)
 	}
     }
     clear_flag(BOUNDARY);
-    clear_setup(STILLPIC);
+    clear_flag(RESYNC);
+    clear_flag(TRICK);
     if (PrimaryDevice)
 	Mute(PrimaryDevice->IsMute());
 }
@@ -28,16 +28,41 @@
 #include "types.h"
 #include "spdif.h"
 #include "bounce.h"
+#include "worker.h"
 #include "bitstreamout.h"
 
-class cReplayOutSPDif : public cAudio, cThread {
+class cReplayOutSPDif;
+
+//
+// Parses the PES packets queued by cReplayOutSPDif::Play()
+// outside of the player thread of VDR.
+//
+class cPesParser : public cThread {
+private:
+    cReplayOutSPDif *const replay;
+    cMutex mutex;
+    cCondVar done;				// Action() has returned
+    volatile bool running;
+protected:
+    virtual void Action(void);
+public:
+    cPesParser(cReplayOutSPDif *owner);
+    void Run(void);
+	//
+	// The flag FLAG_PARSER of the owner has to be cleared before,
+	// the thread is woken up through the queue and joined.
+	//
+    void Stop(void);
+};
+
+class cReplayOutSPDif : public cAudio, cSession {
+    friend class cPesParser;
 private:
     volatile flags_t flags;
     // Private Stream 1 magic
     static const uint_32 PS1magic;
     // Stream detection
-    iec60958* stream;
-    cMutex ctr;
+    cPublish<iec60958> stream;			// Read for each PES packet, no lock
     // magic of streams
     static const uint_16 AC3magic;
     static const uint_32 DTSmagic;
@@ -47,6 +72,9 @@ private:
     #define FLAG_FAILED		2		// We failed
     #define FLAG_BOUNDARY	3		// PES boundary detected
     #define FLAG_WASMUTED	4		// Previous muted
+    #define FLAG_RESYNC		5		// Wait on next aligned PES frame
+    #define FLAG_PARSER		6		// PES parser thread is running
+    #define FLAG_TRICK		7		// Trick mode, drop queued bursts
     // The PES scanner
     inline bool OffsetToDvdOfPS1(const uchar *const b, int &off, const int cnt, const uchar id);
     inline bool ScanPayOfPS1(const uchar *const b, int &off, const int cnt, const uchar id);
@@ -55,11 +83,20 @@ private:
     static uint_8  * pesdata;
     static cBounce * bounce;
     cPsleep wait;
+    // Queue of PES packets from Play() to Parse()
+    cPesQueue queue;
+    cPesParser parser;
+    cMutex parse;
+    // Persistent forwarding thread
+    cWorker worker;
+    void Parse(const uchar *b, int cnt, uchar id);
+    void ClearStream(void);
 protected:
     const char *const SPDIFmute;
     spdif *const spdifDev;
     ctrl_t &setup;
-    virtual void Action(void);
+    virtual void Session(cThread *caller);
+    virtual void Wakeup(void);
     virtual void Activate(bool onoff);	// We do NOT use cReceiver class
 public:
     cReplayOutSPDif(spdif &dev, ctrl_t &up, cBounce * bPtr, const char *script);
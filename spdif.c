@@ -22,6 +22,7 @@
 
 #include <getopt.h>
 #include <unistd.h>
+#include <time.h>
 #include "spdif.h"
 #include "iec60958.h"
 
@@ -107,7 +108,6 @@ spdif::spdif(ctrl_t &up)
     out = NULL;
     stream = NULL;
     delay = 0;
-    pause = 0;
     buffer_size = 0;
     paysize = 0;
     count = 10;
@@ -117,6 +117,11 @@ spdif::spdif(ctrl_t &up)
     fragsize = 0;
     period = 0;
     writei = NULL;
+    stage = NULL;
+    train = NULL;
+    run = NULL;
+    staged = 0;
+    hw.valid = false;
     status = NULL;
     log = NULL;
     opt.card = 0;
@@ -125,6 +130,9 @@ spdif::spdif(ctrl_t &up)
     opt.first = 5;
     opt.mmap = false;
     opt.audio = false;
+    opt.latency = false;
+    margin = 0;
+    memset(&lat, 0, sizeof(lat));
 }
 
 spdif::~spdif()
@@ -140,7 +148,10 @@ bool spdif::Stream(iec60958 *in)
     if (!stream)
 	goto xout;
     burst_size = stream->BurstSize();
-    periods = (16<<10)/burst_size;
+    if (opt.latency)
+	periods = SPDIF_LOWPERIODS;
+    else
+	periods = (16<<10)/burst_size;
     period = ((burst_size * 1000) / stream->SampleRate());
     switch (stream->SampleRate()) {
     case 48000:
@@ -190,11 +201,33 @@ void spdif::Forward(const uint_8 *const data,
     if (!out || !stream)
 	goto xout;
 
+    //
+    // Tell the frame scanner which parts of the data are known
+    // to be damaged by lost or erroneous TS packets.
+    //
+    stream->Untaint();
+    if (bounce) {
+	size_t from[IEC_TAINTS], to[IEC_TAINTS];
+	int n = bounce->damaged(from, to, IEC_TAINTS);
+	for (int i = 0; i < n; i++)
+	    stream->Taint(data + from[i], data + to[i]);
+    }
+
     clear_ctrl(IO);
     while (Frame(pcm, head, tail)) {
 
-	if (ctrlbits & ((1<<FL_NOEXSYNC)|(1<<FL_IO)))
-	    check();
+	//
+	// The data fetched by the caller was limited by Available(),
+	// therefore the state of the sound card buffer is checked
+	// only for the first of the bursts staged for one write.
+	// During underrun recovery every burst is checked.
+	//
+	if (ctrlbits & ((1<<FL_NOEXSYNC)|(1<<FL_IO))) {
+	    if (!staged || test_ctrl(UNDERRUN)) {
+		flush();
+		check();
+	    }
+	}
 	set_ctrl(IO);
 
 	if (ctrlbits & ((1<<FL_FIRST)|(1<<FL_UNDERRUN)|(1<<FL_PAUSE)|(1<<FL_REPEAT)|(1<<FL_OVERRUN))) {
@@ -204,6 +237,7 @@ void spdif::Forward(const uint_8 *const data,
 
 	    if (test_ctrl(FIRST)) {
 		uint_32 duration = (B2F(pcm.size)*1000)/stream->SampleRate();
+		bool resume;
 		int mcnt;
 #define USE_MAD_BUFFER_GUARD
 #ifndef USE_MAD_BUFFER_GUARD
@@ -230,12 +264,10 @@ void spdif::Forward(const uint_8 *const data,
 		// Add delay if any
 		offset += (10*opt.first);
 
-		// After Pause/Mute in Replay mode our buffer is empty
-		// wheras the buffers of VDR are not.
-		if (test_and_clear_ctrl(PAUSE)) {
-		    offset += pause;
-		    pause = 0;
-		}
+		// After Pause/Mute or trick mode in Replay mode the S/P-DIF
+		// was kept prepared and only the queued bursts are dropped,
+		// the PTS offset above does the rest.
+		resume = test_and_clear_ctrl(RESUME);
 
 		Hold(thread);			// Hold the lock on the calling thread
 
@@ -246,16 +278,18 @@ void spdif::Forward(const uint_8 *const data,
 		    register int ddelay = offset/10;
 
 		    if (opt.audio) ddelay += opt.adelay;
+		    lat.start = (ddelay > 0) ? 10*ddelay : 0;
 
 		    for (int n = 0; n < ddelay; n++) {	// Every burst is 10 ms silent
 			switch (check()) {
 			case SPDIF_HIGH:
+			    flush();
 			    Unhold();		// Do not hold lock on calling thread
 			    EINTR_RETRY(snd_pcm_wait(out, 10));
 			    // fall through
 			case SPDIF_OK:
 			default:
-			    burst(silent);
+			    queue(silent);
 			    break;
 			}
 		    }
@@ -275,7 +309,7 @@ void spdif::Forward(const uint_8 *const data,
 		    count = (mcnt < 7) ? 10 : mcnt + 4;
 		} else {
 		    mcnt  = 2;
-		    count = 10;
+		    count = (resume) ? mcnt + 2 : 10;
 		}
 
 		do {
@@ -285,12 +319,14 @@ void spdif::Forward(const uint_8 *const data,
 		    case SPDIF_OK:
 			break;
 		    default:
-			burst(init);
+			queue(init);
 			count--;
 			break;
 		    }
 		} while (count > mcnt);
 
+		flush();			// Silent and start frames at once
+
 		if (opt.audio) count += 5;
 
 		Unhold();			// Do not hold lock on calling thread
@@ -299,6 +335,7 @@ void spdif::Forward(const uint_8 *const data,
 		    EINTR_RETRY(snd_pcm_wait(out, 10));
 
 		ctrlbits &= ~((1<<FL_FIRST)|(1<<FL_UNDERRUN));
+		uncache();			// Stream was (re)started
 		repeat = 0;
 	    }
 
@@ -318,7 +355,7 @@ void spdif::Forward(const uint_8 *const data,
 			    // Use a wait frame for filling
 			    const frame_t fill = stream->Frame(PCM_WAIT2);
 			    stream->SetErr();
-			    burst(fill);
+			    queue(fill);
 			    stream->ClearErr();
 			}
 
@@ -328,7 +365,7 @@ void spdif::Forward(const uint_8 *const data,
 	    
 			if (!(repeat = (++repeat) % 4)) {
 			    stream->SetErr();
-			    burst(pcm);
+			    queue(pcm);
 			    stream->ClearErr();
 			}
 		    }
@@ -344,6 +381,7 @@ void spdif::Forward(const uint_8 *const data,
 
 		    Hold(thread);		// Hold the lock on the calling thread
 
+		    flush();
 		    snd_pcm_drain(out);
 		    snd_pcm_prepare(out);
 		    clear_ctrl(UNDERRUN);
@@ -352,6 +390,7 @@ void spdif::Forward(const uint_8 *const data,
 		}
 
 	    } else if (test_ctrl(OVERRUN)) {
+		flush();
 		wait.msec(10);
 		//
 		// This is a workaround for overruns.
@@ -398,9 +437,96 @@ void spdif::Forward(const uint_8 *const data,
 	}
 
 	paysize = pcm.pay;		// Remember the last pay load size
+	queue(pcm);
+
+    }
+    flush();
+xout:
+    return;
+}
+
+//
+// The framers build their bursts one after the other within the
+// staging area, therefore a burst following the staged ones is
+// only counted and written together with them by flush().  Any
+// other burst, e.g. a special frame or a repeated last burst, is
+// copied into the train area, consecutive special frames are then
+// written at once as well.  Before the framers wrap around to the
+// start of the staging area all is written.
+//
+inline void spdif::queue(const frame_t &pcm)
+{
+    const uint_8 *const data = (const uint_8 *)pcm.burst;
+    const size_t size = F2B(B2F(pcm.size));
+
+    if (!data || !size)
+	goto xout;
+
+    if (!stage) {			// Not opened
 	burst(pcm);
+	goto xout;
+    }
 
+    if (data != run + staged) {
+	if (data < stage || data + size > stage + STAGE_MEM) {
+	    copy(pcm);			// Not within the staging area
+	    goto xout;
+	}
+	flush();
+	run = data;
     }
+
+    staged += size;
+    if (data + size + SPDIF_BURST_SIZE > stage + STAGE_MEM)
+	flush();
+xout:
+    return;
+}
+
+//
+// Append a copy of the burst to the train area, the burst
+// itself may be changed or reused at once.
+//
+inline void spdif::copy(const frame_t &pcm)
+{
+    const size_t size = F2B(B2F(pcm.size));
+
+    if (!pcm.burst || !size)
+	goto xout;
+
+    if (!train || size > TRAIN_MEM) {
+	flush();
+	burst(pcm);
+	goto xout;
+    }
+
+    if (run != train || staged + size > TRAIN_MEM) {
+	flush();
+	run = train;
+    }
+
+    memcpy(train + staged, (const void *)pcm.burst, size);
+    staged += size;
+xout:
+    return;
+}
+
+//
+// Write all staged bursts with one call
+//
+inline void spdif::flush(void)
+{
+    frame_t all;
+
+    if (!staged)
+	goto xout;
+
+    all.burst = (uint_32 *)run;
+    all.size  = staged;
+    all.pay   = staged;
+    run   += staged;
+    staged = 0;
+    burst(all);
 xout:
     return;
 }
@@ -473,6 +599,7 @@ void spdif::burst(const frame_t &pcm)
 xout:
     clear_ctrl(BURSTRUN);
     stream->pts.lead(term);
+    hw.written += term;
 
     return;
 }
@@ -493,6 +620,12 @@ bool spdif::Open(iec60958 *in, cThread *caller)
 
     ctrlbits = (1<<FL_FIRST)|(1<<FL_NOEXSYNC);
     thread = caller;
+    stage  = setup.buf + STAGE_START;
+    train  = setup.buf + TRAIN_START;
+    run    = NULL;
+    staged = 0;
+    opt.latency = setup.opt.latency;
+    memset(&lat, 0, sizeof(lat));
 
     if (!Stream(in))
 	goto err_null;
@@ -608,7 +741,7 @@ __diga_end:
     }
     {
 	int fifo = 0;
-	unsigned int frag;
+	unsigned int frag, lowest;
 	snd_pcm_uframes_t part, period_min, period_max, first;
 	snd_pcm_hw_params_t *hwparams;
 	snd_pcm_sw_params_t *swparams;
@@ -675,8 +808,14 @@ __diga_end:
 	if (opt.mmap)
 	    period_max = MMAP_BURST;
 
-	
-	frag = 0;
+	//
+	// The low latency profile splits a burst into small periods of
+	// the sound card to be woken up more often, if the card does not
+	// support this we fall back to the largest possible periods.
+	//
+	lowest = (opt.latency) ? SPDIF_LOWFRAGS : 1;
+    again:
+	frag = lowest - 1;
 	do {
 	    frag++;
 	    part = burst_size/frag;
@@ -698,6 +837,11 @@ __diga_end:
 
 	} while (frag < 10);
 
+	if (err < 0 && lowest > 1) {
+	    lowest = 1;
+	    goto again;
+	}
+
 	if (err < 0) {
 	    esyslog("S/P-DIF: No valid period size available: %s", snd_strerror(err));
 	    period_size = 0;
@@ -767,11 +911,23 @@ __diga_end:
 	{
 	    snd_pcm_uframes_t tenth;
 	    buffer_size = err;
-	    tenth = buffer_size/10;
-	    buf.upper = buffer_size - 3*tenth;
-	    buf.lower = (opt.audio ? 2 : 4)*tenth;
-	    buf.high  = buffer_size - tenth;
-	    buf.alarm = tenth/3;
+	    if (opt.latency) {
+		// Keep about two bursts within the buffer
+		buf.upper = buffer_size - burst_size;
+		buf.lower = burst_size;
+		buf.high  = buffer_size - burst_size/2;
+		buf.alarm = burst_size/2;
+		margin = burst_size;
+	    } else {
+		tenth = buffer_size/10;
+		buf.upper = buffer_size - 3*tenth;
+		buf.lower = (opt.audio ? 2 : 4)*tenth;
+		buf.high  = buffer_size - tenth;
+		buf.alarm = tenth/3;
+		margin = 3*burst_size;
+	    }
+	    dsyslog("S/P-DIF: %s latency profile, %lu bursts of %d ms, %u periods per burst",
+		    (opt.latency) ? "low" : "default", periods, period, frag);
 	}
 
 	if (snd_pcm_hw_params_can_pause(hwparams) == 1)
@@ -889,11 +1045,27 @@ void spdif::Close(cThread *caller)
     Clear(exit);
     Unhold();					// leave holded lock
 
+    //
+    // The output latency is the delay within the sound card buffer
+    // plus the silent bursts queued for the PTS and start-up offset
+    //
+    if (lat.count && period > 0) {
+	const unsigned long frames = lat.sum/lat.count;
+	dsyslog("S/P-DIF: %s latency profile, output latency %lu ms average, %lu ms maximum"
+		" (start-up offset %lu ms)",
+		(opt.latency) ? "low" : "default",
+		lat.start + (frames*period)/burst_size,
+		lat.start + ((unsigned long)lat.max*period)/burst_size, lat.start);
+    }
+
     thread = NULL;
     out    = NULL;
     stream = NULL;
     delay  = 0;
-    pause  = 0;
+    stage  = NULL;
+    train  = NULL;
+    run    = NULL;
+    staged = 0;
 
     // Cleanup
     snd_pcm_nonblock(tmp, SND_PCM_NONBLOCK);
@@ -936,6 +1108,9 @@ void spdif::Clear(bool exit)
     if (test_ctrl(FIRST))
 	goto xout;
 
+    if (!exit && !test_setup(LIVE))
+	set_ctrl(RESUME);			// Replay: the caller resets its stream
+
     if ((err = snd_pcm_status(out, status)) < 0) {
 	esyslog("S/P-DIF: clear: status error: %s", snd_strerror(err));
 	goto xout;
@@ -946,7 +1121,6 @@ void spdif::Clear(bool exit)
 
 	if (exit) {
 	    clear_ctrl(PAUSE);
-	    pause = 0;				// VDR has cleared its buffers
 
 	    if (stream) {
 		// Say decoder to wait for pause or stop
@@ -977,32 +1151,28 @@ void spdif::Clear(bool exit)
 		    break;
 		}
 	    }
-	} else {
+	} else if (!test_setup(LIVE)) {
 
 	    Unhold();				// Leave any thead lock if any
 
 	    //
-	    // In Replay mode VDR does _not_ empty its buffers for Pause
+	    // Pause or trick mode in Replay mode: drop only the queued
+	    // bursts, the stream is prepared again below and the next
+	    // frames will be synchronized to the new PTS in Forward().
 	    //
-	    do {
-		if (test_setup(LIVE))		// Only in Replay mode
-		    break;
-		if (!test_setup(STILLPIC))	// Only for still pictures
-		    break;
-		if (test_ctrl(FIRST))		// Already stopped
+	    if ((err = snd_pcm_drop(out)) < 0) {
+		switch (err) {
+		case -ESTRPIPE:
+		    xsuspend();
 		    break;
-		if (!stream)	 		// No stream open
+		default:
+		    esyslog("S/P-DIF: clear: drop error: %s", snd_strerror(err));
 		    break;
+		}
+	    }
+	} else {
 
-		// Calculate addon of start delay in ms
-		(void)snd_pcm_hwsync(out);
-		if (snd_pcm_delay(out, &pause) < 0)
-		    pause = 0;
-		else
-		    pause = (pause*1000)/stream->SampleRate();
-		clear_setup(STILLPIC);
-
-	    } while (0);
+	    Unhold();				// Leave any thead lock if any
 
 	    if ((err = snd_pcm_drain(out)) < 0) {
 		switch (err) {
@@ -1023,8 +1193,8 @@ void spdif::Clear(bool exit)
 	// fall through
     case SND_PCM_STATE_PREPARED:
 	set_ctrl(FIRST);
-	if (stream)
-	    stream->Clear();
+	if (stream && !test_ctrl(RESUME))
+	    stream->Clear();			// Otherwise done by the caller
 	break;
     } // switch (snd_pcm_status_get_state())
 xout:
@@ -1070,15 +1240,36 @@ repeat:
 	    if (!delay) break;
 	    // else fall through
 	case SPDIF_OK:
+	    if (opt.latency) {
+		due(delay);		// Sleep until the next burst is due
+		check();
+	    }
 	    wait = (period*(delay-buf.alarm))/burst_size;
 	    if (wait < 2*period) {
 		if (wait > 0 && bounce->poll(wait))
 		    goto xout;
+		//
+		// The low latency profile keeps only about two bursts
+		// queued, a late input is jitter and not the end of
+		// the stream.  Repeat the last burst up to the point
+		// where the next one is due instead of a restart.
+		//
+		if (opt.latency) {
+		    int times = 1;
+
+		    check();
+		    if (test_ctrl(FIRST))
+			goto do_wait;	// Already an underrun
+		    if ((snd_pcm_uframes_t)delay < buf.lower + burst_size)
+			times += (buf.lower + burst_size - delay)/burst_size;
+		    if (xrepeat(times))
+			goto repeat;
+		}
 	    } else {
 		wait = 2*period;
 		if (bounce->poll(wait))
 		    goto xout;
-		if (xrepeat())		// Repeat last frame for a while
+		if (xrepeat(wait/period))	// Repeat the drained bursts for a while
 		    goto repeat;
 	    }
 	default:
@@ -1122,7 +1313,11 @@ do_wait:
     return (test_ctrl(PAUSE)) ? true : ready;
 }
 
-inline bool spdif::xrepeat(void)
+//
+// Repeat the last burst, to catch up all repeated bursts
+// are written at once.
+//
+inline bool spdif::xrepeat(const int times)
 {
     bool ret = true;
     frame_t pcm;
@@ -1136,8 +1331,11 @@ inline bool spdif::xrepeat(void)
 	set_ctrl(REPEAT);
 	gettimeofday(&xrstart, NULL);
     }
-    if (ret && stream && (pcm = stream->Frame()).burst)
-	burst(pcm);
+    if (ret && stream && (pcm = stream->Frame()).burst) {
+	for (int n = 0; n < times; n++)
+	    copy(pcm);
+	flush();
+    }
 
     return ret;
 }
@@ -1241,15 +1439,11 @@ int spdif::check(snd_pcm_status_t * status)
     if (test_ctrl(FIRST))	// No AC3 running is LOW
 	return grade;
 
-    if (status)
+    if (status) {
 	delay = snd_pcm_status_get_delay(status);
-    else {
-	(void)snd_pcm_hwsync(out);
-	if (opt.mmap || test_ctrl(FIRST))
-	    delay = snd_pcm_avail_update(out);
-	else
-	    snd_pcm_delay(out, &delay);
-    }
+	hwcache(delay);
+    } else
+	delay = hwdelay();
 
     if (delay < 0) {
 	xunderrun();
@@ -1260,6 +1454,12 @@ int spdif::check(snd_pcm_status_t * status)
 	goto xout;
     }
 
+    // Latency of the current profile
+    lat.sum += delay;
+    lat.count++;
+    if (delay > lat.max)
+	lat.max = delay;
+
     // Underrun dection for setting variable period size
     if      ((snd_pcm_uframes_t)delay <= buf.lower)
 	set_ctrl(UNDERRUN);
@@ -1279,6 +1479,82 @@ xout:
     return grade;
 }
 
+//
+// Low latency profile: sleep until the sound card buffer is
+// drained down to the point where the next burst is due, that
+// is about two bursts before an underrun.
+//
+inline void spdif::due(const snd_pcm_sframes_t queued)
+{
+    const snd_pcm_sframes_t target = buf.lower + burst_size;
+    struct timespec deadline;
+    long long nsec;
+
+    if (queued <= target || !stream)
+	goto xout;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &deadline) < 0)
+	goto xout;
+
+    nsec = ((long long)(queued - target)*1000000000LL)/stream->SampleRate();
+    deadline.tv_sec  += nsec/1000000000LL;
+    deadline.tv_nsec += nsec%1000000000LL;
+    if (deadline.tv_nsec >= 1000000000L) {
+	deadline.tv_sec++;
+	deadline.tv_nsec -= 1000000000L;
+    }
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+	;
+xout:
+    return;
+}
+
+//
+// Remember the queried delay of the sound card buffer
+//
+inline void spdif::hwcache(const snd_pcm_sframes_t value)
+{
+    hw.delay   = value;
+    hw.written = 0;
+    hw.valid   = (value >= 0) && (clock_gettime(CLOCK_MONOTONIC, &hw.stamp) == 0);
+}
+
+//
+// Frames queued in the sound card buffer.  The hardware is asked
+// at most once per period, in between the delay is extrapolated
+// with the monotonic clock and the frames written by burst().  With
+// memory mapping the hardware pointer is read from the mmapped status
+// page of ALSA without any system call.
+//
+inline snd_pcm_sframes_t spdif::hwdelay(void)
+{
+    snd_pcm_sframes_t res = 0;
+    struct timespec now;
+
+    if (hw.valid && stream && clock_gettime(CLOCK_MONOTONIC, &now) == 0) {
+	const long long nsec = (now.tv_sec - hw.stamp.tv_sec)*1000000000LL
+			     + (now.tv_nsec - hw.stamp.tv_nsec);
+	if (nsec >= 0 && nsec < period*1000000LL) {
+	    res = hw.delay + hw.written - (nsec*stream->SampleRate())/1000000000LL;
+	    if (res > 0)
+		goto out;		// Otherwise ask for an underrun
+	}
+    }
+
+    if (opt.mmap) {
+	if ((res = snd_pcm_avail_update(out)) >= 0)
+	    res = buffer_size - res;
+    } else {
+	(void)snd_pcm_hwsync(out);
+	if (snd_pcm_delay(out, &res) < 0)
+	    res = 0;
+    }
+    hwcache(res);
+out:
+    return res;
+}
+
 //
 // Return available space for next PCM frames and avoid
 // to block burst() by overrun the sound cards buffer
@@ -1298,7 +1574,7 @@ size_t spdif::Available(const size_t max)
 	    if (test_ctrl(FIRST))
 		break;
 	case SPDIF_OK:			// Fill up to upper boundary (and empty bounce buffer)
-	    initial = delay + 3*burst_size;
+	    initial = delay + margin;
 	    if (initial >= buffer_size)
 		goto xout;		// hold data in bounce buffer
 	    avail = buffer_size - initial;
@@ -1311,7 +1587,7 @@ size_t spdif::Available(const size_t max)
     }
 
     if (test_ctrl(FIRST)) {		// Be able to start without delay
-	initial = silent.size*opt.first + 3*burst_size;
+	initial = silent.size*opt.first + margin;
 	if (initial >= buffer_size)
 	    goto xout;			// hold data in bounce buffer
 	avail = buffer_size - initial;
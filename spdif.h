@@ -77,7 +77,6 @@ private:
     snd_pcm_uframes_t burst_size;
     snd_pcm_uframes_t periods;
     snd_pcm_sframes_t delay;
-    snd_pcm_sframes_t pause;
     snd_pcm_uframes_t buffer_size;
     snd_pcm_format_t  format;
     int count;
@@ -102,7 +101,8 @@ private:
 	FL_BURSTRUN = 7,	// burst() active
 	FL_PAUSE    = 8,	// Pause() called
 	FL_OVERRUN  = 9,	// Overrun detected
-	FL_REPEAT   = 10	// Repeat last frame upto 1 second
+	FL_REPEAT   = 10,	// Repeat last frame upto 1 second
+	FL_RESUME   = 11	// Resume after pause/trick mode, S/P-DIF kept prepared
     };
     flags_t ctrlbits;
 #   define test_and_set_ctrl(ctrl)         test_and_set_bit  (FL_ ## ctrl, &ctrlbits)
@@ -111,8 +111,18 @@ private:
 #   define set_ctrl(ctrl)                  set_bit  (FL_ ## ctrl, &ctrlbits)
 #   define clear_ctrl(ctrl)                clear_bit(FL_ ## ctrl, &ctrlbits)
     virtual void burst(const frame_t &pcm);
+    // Consecutive bursts built by the framers within the
+    // staging area are written at once, special and repeated
+    // bursts are copied one after the other into the train area
+    uint_8 *stage;
+    uint_8 *train;
+    const uint_8 *run;
+    size_t staged;
+    inline void queue(const frame_t &pcm);
+    inline void copy(const frame_t &pcm);
+    inline void flush(void);
     struct timeval xrstart;
-    inline bool xrepeat(void);
+    inline bool xrepeat(const int times = 1);
     inline void xunderrun(void);
     inline void xsuspend (void);
     // Block signals during handlers
@@ -122,6 +132,29 @@ private:
     // buffer checking
     enum {SPDIF_LOW = -1, SPDIF_OK = 0, SPDIF_HIGH = 1};
     virtual int check(snd_pcm_status_t * status = NULL);
+    // Low latency profile
+#   define SPDIF_LOWPERIODS	4	// Bursts within the sound card buffer
+#   define SPDIF_LOWFRAGS	4	// Periods of the sound card per burst
+    snd_pcm_uframes_t margin;		// Space kept free by Available()
+    inline void due(const snd_pcm_sframes_t queued);
+    // Measured latency of the current profile
+    struct {
+	unsigned long long sum;
+	unsigned long count;
+	snd_pcm_sframes_t max;
+	unsigned long start;		// PTS and start-up offset in ms
+    } lat;
+    // Cached state of the sound card buffer, queried at most
+    // once per period and extrapolated in between
+    struct {
+	snd_pcm_sframes_t delay;	// Queued frames at time stamp
+	snd_pcm_uframes_t written;	// Frames written since time stamp
+	struct timespec stamp;
+	bool valid;
+    } hw;
+    inline snd_pcm_sframes_t hwdelay(void);
+    inline void hwcache(const snd_pcm_sframes_t value);
+    inline void uncache(void) { hw.valid = false; };
     struct {
 	snd_pcm_uframes_t upper;
 	snd_pcm_uframes_t lower;
@@ -145,6 +178,7 @@ private:
 	unsigned int iec958_aes0_pro_fs_rate;
 	bool mmap;
 	bool audio;
+	bool latency;
     } opt;
     ctrl_t &setup;
     cPsleep wait;
@@ -41,6 +41,7 @@
 #include <signal.h>
 #include <netinet/in.h>
 #include "handle.h"
+#include "passthru.h"
 
 #define FRAMESPERSEC 25
 
@@ -71,177 +72,178 @@ static pts_t pts;
 #define P_FRAME		2
 #define B_FRAME		3
 
-class cFrame {
+//
+// All frames between two calls of cOut::Pop() are kept in an arena:
+// slabs of memory handed out piece by piece and rewound at once if
+// the frames are dropped, therefore neither the frames nor their
+// payload go through malloc(3) for each packet.
+//
+#define ARENA_SLAB	(256*1024)
+
+class cArena {
 private:
-    uint_8  type;	// Type like 0x0e for video
-    uint_8  picture;	// For video only: I/P/B frame
-    uint_8 *data;
-    uint_32 len;
+    typedef struct _slab {
+	struct _slab *next;
+	size_t used;
+	size_t size;
+	uint_8 data[0];
+    } slab_t;
+    slab_t *head;
+    slab_t *curr;
 public:
-    cFrame(const uint_8 id, const uint_8 *const ptr, const uint_32 cnt, const uint_8 pt = NO_PICTURE)
-    : type(0), data(NULL), len(0)
+    cArena() : head(NULL), curr(NULL) {};
+    virtual ~cArena()
     {
-	if (!(data = (uint_8*)malloc(sizeof(uint_8)*cnt))) {
-	    esyslog("cFrame: can not alloc memory (%s)", strerror(errno));
-	    return;
+	while (head) {
+	    slab_t *next = head->next;
+	    free(head);
+	    head = next;
 	}
-	type = id;
-	memcpy(data, ptr, cnt);
-	len = cnt;
-	picture = pt;
-    }
-    virtual ~cFrame(void)
-    {
-	if (data) free(data);
-	data = NULL;
-	len  = 0;
-	type = 0;
+	curr = NULL;
     };
-    virtual void Append(const uint_8 *const ptr, const uint_32 cnt)
+    void *Alloc(size_t len)
     {
-	uint_32 add = len + cnt;
-	if (!(data = (uint_8*)realloc(data, sizeof(uint_8)*add))) {
-	    esyslog("cFrame: can not extend memory (%s)", strerror(errno));
-	    return;
+	void *ptr = NULL;
+	len = (len + 7) & ~7;
+	if (curr && (curr->size - curr->used >= len))
+	    goto out;
+	if (curr && curr->next && (curr->next->size >= len)) {
+	    curr = curr->next;			// Reuse slab after Reset()
+	    curr->used = 0;
+	    goto out;
+	}
+	{
+	    const size_t size = (len > ARENA_SLAB) ? len : ARENA_SLAB;
+	    slab_t *slab = (slab_t*)malloc(sizeof(slab_t) + size);
+	    if (!slab) {
+		esyslog("cArena: can not alloc memory (%s)", strerror(errno));
+		return NULL;
+	    }
+	    slab->used = 0;
+	    slab->size = size;
+	    if (curr) {
+		slab->next = curr->next;
+		curr->next = slab;
+	    } else {
+		slab->next = head;
+		head = slab;
+	    }
+	    curr = slab;
 	}
-	memcpy(data+len, ptr, cnt);
-	len = add;
+    out:
+	ptr = curr->data + curr->used;
+	curr->used += len;
+	return ptr;
+    };
+    void Reset(void)
+    {
+	if ((curr = head))
+	    curr->used = 0;
     };
-    virtual uint_8 Type(void) const { return type; };
 };
 
-template<class T> class cGrip {
-    friend class cFrames;
-private:
-    cGrip *prev, *next;
-    T* rivet;
-public:
-    cGrip(T* object = NULL) : prev(this), next(this), rivet(object) {};
-};
+//
+// The payload of a frame is a chain of chunks, appending a packet
+// adds a chunk instead of moving the whole frame with realloc(3).
+//
+typedef struct _chunk {
+    struct _chunk *next;
+    uint_32 len;
+    uint_8 data[0];
+} chunk_t;
+
+typedef struct _frame {
+    struct _frame *next;	// Next frame in order of Put()
+    struct _frame *hash;	// Next frame within the same hash bucket
+    chunk_t *first, *last;
+    uint_64 stamp;
+    sint_64 offset;		// For B frames pointing backwards
+    uint_32 len;
+    uint_8  type;		// Type like 0xe0 for video
+    uint_8  picture;		// For video only: I/P/B frame
+} frame_t;
 
-class cPresentation {
-    friend class cFrames;
-private:
-    cGrip<cPresentation> *grip;
-    const uint_64 stamp;
-    const sint_64 offset;		// For B frames pointing backwards
-    cFrame *frame;
-public:
-    cPresentation(const uint_64 pts, const sint_64 off = 0)
-	: grip(new cGrip<cPresentation>(this)), stamp(pts), offset(off), frame(NULL)
-	{};
-    virtual ~cPresentation()        { delete frame; frame = NULL; };
-    virtual void Add  (cFrame *Frame) { frame = Frame; };
-    virtual const uint_64 Stamp(void) const { return stamp; };
-    virtual cFrame* Frame(void) const { return frame; };
-};
+//
+// Frames are found by type and stamp with a hash, newer frames are
+// found first as done by the reverse search of the former list.
+//
+#define OUT_HASH	1024
 
-class cFrames {
+class cOut {
 private:
-    cGrip<cPresentation> *head;
-public:
-    cFrames () : head(new cGrip<cPresentation>) {};
-    virtual ~cFrames ()  { Clear(); };
-    void Put(cPresentation *Stamp, cPresentation *Here = NULL, bool before = false)
+    uint_32 iframes;
+    cArena arena;
+    frame_t *head, *tail;
+    frame_t *hash[OUT_HASH];
+    static inline unsigned int key(const uint_64 stamp, const uint_8 type)
     {
-	if (!Stamp)
-	    return;
-	cGrip<cPresentation> *here = ((!Here) ? head->prev : Here->grip);
-	cGrip<cPresentation> *grip = Stamp->grip;
-
-	cGrip<cPresentation> *prev, *next;
-	if (before) {
-	    prev = here->prev;
-	    next = here;
-	} else {
-	    prev = here;
-	    next = here->next;
-	}
-
-	next->prev = grip;
-	grip->next = next;
-	grip->prev = prev;
-	prev->next = grip;
+	return (unsigned int)((stamp ^ (stamp >> 10) ^ ((uint_64)type << 3)) & (OUT_HASH-1));
     };
-    cPresentation *Get(cPresentation *Stamp, bool reverse = false)
+    chunk_t *chunk(const uint_8 * ptr, const uint_32 cnt)
     {
-	cGrip<cPresentation> *grip = ((!Stamp) ? head : Stamp->grip);
-
-	if (reverse)
-	    grip = grip->prev;
-	else
-	    grip = grip->next;
-
-	return grip->rivet;
+	chunk_t *c = (chunk_t*)arena.Alloc(sizeof(chunk_t) + cnt);
+	if (!c)
+	    return NULL;
+	c->next = NULL;
+	c->len = cnt;
+	memcpy(c->data, ptr, cnt);
+	return c;
     };
-    void Drop(cPresentation *Stamp)
+    void put(const uint_64 stamp, const sint_64 off, const uint_8 ub, const uint_8 * ptr,
+	     const uint_32 cnt, const uint_8 pt = NO_PICTURE)
     {
-	if (!Stamp)
+	const unsigned int k = key(stamp, ub);
+	frame_t *frame = (frame_t*)arena.Alloc(sizeof(frame_t));
+	if (!frame || !(frame->first = frame->last = chunk(ptr, cnt)))
 	    return;
-	cGrip<cPresentation> *grip = Stamp->grip;
-	cGrip<cPresentation> *prev = grip->prev;
-	cGrip<cPresentation> *next = grip->next;
-
-	next->prev = prev;
-	prev->next = next;
-	delete Stamp;
-	Stamp = NULL;
+	frame->stamp = stamp;
+	frame->offset = off;
+	frame->len = cnt;
+	frame->type = ub;
+	frame->picture = pt;
+	frame->next = NULL;
+	if (tail)
+	    tail->next = frame;
+	else
+	    head = frame;
+	tail = frame;
+	frame->hash = hash[k];
+	hash[k] = frame;
     };
-    virtual void Clear(void)
+    void add(const uint_64 stamp, const uint_8 ub, const uint_8 * ptr, const uint_32 cnt)
     {
-	class cPresentation *p = NULL;
-	while ((p = Get(p)))
-	    Drop(p);
+	frame_t *frame;
+	chunk_t *c;
+	for (frame = hash[key(stamp, ub)]; frame; frame = frame->hash)
+	    if (frame->stamp == stamp && frame->type == ub)
+		break;
+	if (!frame || !(c = chunk(ptr, cnt)))
+	    return;
+	frame->last->next = c;
+	frame->last = c;
+	frame->len += cnt;
     };
-};
-
-class cOut {
-private:
-    uint_32 iframes;
 public:
-    cFrames Ring, *Video, *Audio, *Digital;
-    cOut() : Video(&Ring), Audio(&Ring), Digital(&Ring) {};
+    cOut() : iframes(0), arena(), head(NULL), tail(NULL) { memset(hash, 0, sizeof(hash)); };
     void Put(const pts_t pts, const uint_8 ub, const uint_8 * ptr, const uint_32 cnt, const uint_8 pt = NO_PICTURE) {
 	const int id = (ub & 0x1f);
-	cPresentation * present;
 	switch (ub) {
 	case 0xe0:
 	    if (pt == NO_PICTURE)
 		break;
-	    if ((present = new cPresentation(pts.vid, pts.off))) {
-		cFrame *frame = new cFrame(ub, ptr, cnt, pt);
-		if (frame) {
-		    present->Add(frame);
-		    Video->Put(present);
-		    if (pt == I_FRAME)
-			iframes++;
-		} else
-		    delete present;
-	    }
+	    put(pts.vid, pts.off, ub, ptr, cnt, pt);
+	    if (pt == I_FRAME)
+		iframes++;
 	    break;
 	case 0xc0 ... 0xdf:
 	    if (id >= 8)
 		break;
-	    if ((present = new cPresentation(pts.aud[id]))) {
-		cFrame *frame = new cFrame(ub, ptr, cnt);
-		if (frame) {
-		    present->Add(frame);
-		    Audio->Put(present);
-		} else
-		    delete present;
-	    }
+	    put(pts.aud[id], 0, ub, ptr, cnt);
 	    break;
 	case 0x80 ... 0x87:
 	case 0x88 ... 0x8f:
 	case 0xa0 ... 0xa7:
-	    if ((present = new cPresentation(pts.ps1))) {
-		cFrame *frame = new cFrame(ub, ptr, cnt);
-		if (frame) {
-		    present->Add(frame);
-		    Digital->Put(present);
-		} else
-		    delete present;
-	    }
+	    put(pts.ps1, 0, ub, ptr, cnt);
 	    break;
 	default:
 	    dsyslog("Put(): unknown id 0x%02X", ub);
@@ -250,44 +252,19 @@ public:
     }
     void Add(const pts_t pts, const uint_8 ub, const uint_8 * ptr, const uint_32 cnt) {
 	const int id = (ub & 0x1f);
-	cPresentation * present = NULL;
 	switch (ub) {
 	case 0xe0:
-	    while ((present = Video->Get(present,true))) {
-		if (present->Stamp() == pts.vid) {
-		    cFrame *frame = present->Frame();
-		    if (frame && frame->Type() == ub) {
-			frame->Append(ptr, cnt);
-			break;
-		    }
-		}
-	    }
+	    add(pts.vid, ub, ptr, cnt);
 	    break;
 	case 0xc0 ... 0xdf:
 	    if (id >= 8)
 		break;
-	    while ((present = Audio->Get(present,true))) {
-		if (present->Stamp() == pts.aud[id]) {
-		    cFrame *frame = present->Frame();
-		    if (frame && frame->Type() == ub) {
-			frame->Append(ptr, cnt);
-			break;
-		    }
-		}
-	    }
+	    add(pts.aud[id], ub, ptr, cnt);
 	    break;
 	case 0x80 ... 0x87:
 	case 0x88 ... 0x8f:
 	case 0xa0 ... 0xa7:
-	    while ((present = Digital->Get(present,true))) {
-		if (present->Stamp() == pts.ps1) {
-		    cFrame *frame = present->Frame();
-		    if (frame && frame->Type() == ub) {
-			frame->Append(ptr, cnt);
-			break;
-		    }
-		}
-	    }
+	    add(pts.ps1, ub, ptr, cnt);
 	    break;
 	default:
 	    dsyslog("Add(): unknown id 0x%02X", ub);
@@ -296,13 +273,12 @@ public:
     }
     void Pop(void)
     {
-	if (iframes > 2) {
-	    class cPresentation *p = NULL;
-	    while ((p = Ring.Get(p))) {
-		cFrame *frame = p->Frame();
-		dsyslog("Frame 0x%02X %llu", frame->Type(), p->Stamp());
-		Ring.Drop(p);
-	    }
+	if (iframes > 2 && head) {
+	    for (frame_t *frame = head; frame; frame = frame->next)
+		dsyslog("Frame 0x%02X %llu", frame->type, frame->stamp);
+	    head = tail = NULL;
+	    memset(hash, 0, sizeof(hash));
+	    arena.Reset();
 	}
     };
 };
@@ -360,10 +336,13 @@ static struct option long_option[] =
 {
     {"help",      0, NULL,  'h'},
     {"block",     0, NULL,  'b'},
+    {"direct",    0, NULL,  'D'},
     {"output",    1, NULL,  'o'},
     {"noslices",  1, NULL,  's'},
     {"noaudpay",  1, NULL,  'a'},
     {"nobdpay",   1, NULL,  'd'},
+    {"cut",       1, NULL,  'c'},
+    {"marks",     1, NULL,  'm'},
     { NULL,       0, NULL,   0 },
 };
 
@@ -373,10 +352,14 @@ static void help(void)
         printf("\nAvailable options:\n");
         printf("  -h, --help         this help\n");
         printf("  -b, --block        use blocking read mode on stdin\n");
+        printf("  -D, --direct       read files with O_DIRECT bypassing the page cache\n");
         printf("  -o, --output=file  use this file for output\n");
         printf("  -s, --noslices     do not show video slice nor sequences\n");
         printf("  -a, --noaudpay     do not show payload of audio streams\n");
         printf("  -d, --nobdpay      do not show payload of private stream 1\n");
+        printf("  -c, --cut=file     cut the recording in the current directory\n");
+        printf("                     by its marks into file, `-' for stdout\n");
+        printf("  -m, --marks=file   use this file instead of marks.vdr\n");
 }
 
 // Forward declaration
@@ -384,19 +367,25 @@ static bool skip_audpay = false;
 static bool skip_slices = false;
 static bool skip_bd_pay = false;
 static void scan(cHandle handle);
+static int cut(const char *marks, const char *output);
 
 int main(int argc, char *argv[])
 {
     bool block = false;
+    int mode = HANDLE_ASYNC;
     cHandle *handle;
     char *output;
+    const char *cutto = NULL, *marks = "marks.vdr";
     int c;
 
-    while ((c = getopt_long(argc, argv, "bo:hsad", long_option, NULL)) > 0) {
+    while ((c = getopt_long(argc, argv, "bDo:hsadc:m:", long_option, NULL)) > 0) {
 	switch (c) {
 	case 'b':
 	    block = true;
 	    break;
+	case 'D':
+	    mode |= HANDLE_DIRECT;
+	    break;
 	case 'o':
 	    if (!optarg || *optarg == '-') {
 		help();
@@ -424,6 +413,12 @@ int main(int argc, char *argv[])
 	case 'd':
 	    skip_bd_pay = true;
 	    break;
+	case 'c':
+	    cutto = optarg;
+	    break;
+	case 'm':
+	    marks = optarg;
+	    break;
 	default:
 	    help();
 	    exit(1);
@@ -445,9 +440,12 @@ int main(int argc, char *argv[])
     install_sighandler(SIGPIPE);
     install_sighandler(SIGIO);
 
+    if (cutto)
+	exit(cut(marks, cutto) < 0 ? 1 : 0);
+
 #   define STEPSIZE	 4096
 #   define OVERALL	(128*STEPSIZE)
-    static uint_8* buf = (uint_8*)malloc(OVERALL);
+    static uint_8* buf = (uint_8*)valloc(OVERALL);	// Page aligned for O_DIRECT
 
     if (!buf)
 	exit(1);
@@ -479,7 +477,7 @@ int main(int argc, char *argv[])
 	}
 	loop = false;
 
-	handle = new cHandle(&buf[0], OVERALL, STEPSIZE, fd);
+	handle = new cHandle(&buf[0], OVERALL, STEPSIZE, fd, mode);
 
 	scan(*handle);
 
@@ -1094,3 +1092,192 @@ static off_t scan_ac3(uint_8* const buf, const off_t rest, pts_t pts, const bool
 
     return rest;
 }
+
+//
+// Cut mode: the cut points are located with the index.vdr of the
+// recording and the spans between them are copied unchanged within
+// the kernel, with copy_file_range(2) into regular files and with
+// splice(2) into pipes.  Only the first video packet of a span is
+// read to mark the group of pictures after a cut as broken link as
+// VDR does, the time stamps are not touched.
+//
+struct tIndex {int offset; unsigned char type; unsigned char number; short reserved; };
+
+static int passmode = PASS_BUFFER;
+
+//
+// Write the video packet at the start of a span with the broken
+// link flag set in its group of pictures, returns the length of
+// the packet or zero if the span does not start with video.
+//
+static ssize_t boundary(const int in, const off_t from, const size_t len, const int out)
+{
+    static uint_8 pkt[6+65535];
+    uint_8 *p, *e;
+    size_t w;
+
+    if (len < 9 || pread(in, pkt, 9, from) != 9)
+	return 0;
+    if (pkt[0] || pkt[1] || pkt[2] != 0x01 || pkt[3] < 0xe0 || pkt[3] > 0xef)
+	return 0;
+    if ((w = ((pkt[4] << 8) | pkt[5]) + 6) > len)
+	return 0;
+    if (pread(in, pkt, w, from) != (ssize_t)w)
+	return 0;
+
+    e = pkt + w;
+    p = pkt + (((pkt[6] & 0xc0) == 0x80) ? (9 + pkt[8]) : 6);
+    for (; p + 8 <= e; p++) {
+	if (p[0] || p[1] || p[2] != 0x01)
+	    continue;
+	if (p[3] == 0x00)		// Picture before any group of pictures
+	    break;
+	if (p[3] == 0xb8) {		// Group of Pictures
+	    if (!(p[7] & 0x40))		// Not a closed one
+		p[7] |= 0x20;		// Broken link
+	    break;
+	}
+    }
+
+    if (writeall(out, pkt, w) < 0)
+	return -1;
+    return w;
+}
+
+static long iframe(const struct tIndex *index, const long entries, long i)
+{
+    if (i < 0)
+	i = 0;
+    while (i < entries && index[i].type != I_FRAME)
+	i++;
+    return i;
+}
+
+//
+// Copy the frames b up to but not including e, the latter
+// may be the number of entries to copy up to the end.
+//
+static int span(const struct tIndex *index, const long entries, const long b, const long e, const int out)
+{
+    static int in = -1, current = 0;
+    const int first = index[b].number;
+    const int last  = (e < entries) ? index[e].number : index[entries-1].number;
+    int number;
+
+    for (number = first; number <= last; number++) {
+	struct stat st;
+	off_t from = 0, to;
+	ssize_t w;
+
+	if (number != current) {
+	    char fname[20];
+	    if (in >= 0)
+		close(in);
+	    sprintf(fname, "%03d.vdr", number);
+	    if ((in = open(fname, O_RDONLY|O_NOCTTY)) < 0) {
+		esyslog("Couldn't open file %s: %s", fname, strerror(errno));
+		return -1;
+	    }
+	    current = number;
+	}
+	if (fstat(in, &st) < 0) {
+	    esyslog("fstat() failed: %s", strerror(errno));
+	    return -1;
+	}
+	to = st.st_size;
+
+	if (number == first)
+	    from = index[b].offset;
+	if (number == last && e < entries)
+	    to = index[e].offset;
+	if (to <= from)
+	    continue;
+
+	if (number == first && b > 0) {
+	    if ((w = boundary(in, from, to - from, out)) < 0)
+		return -1;
+	    from += w;
+	}
+	if (copyrange(in, from, to - from, out, passmode) < 0)
+	    return -1;
+    }
+    return 0;
+}
+
+static int cut(const char *marks, const char *output)
+{
+    struct tIndex *index = NULL;
+    long entries = 0, *frame = NULL;
+    int count = 0, max = 0, fd = -1, out = STDOUT_FILENO, ret = -1;
+    char line[256];
+    struct stat st;
+    FILE *fp;
+
+    if ((fd = open("index.vdr", O_RDONLY|O_NOCTTY)) < 0 || fstat(fd, &st) < 0) {
+	esyslog("Couldn't open file index.vdr: %s", strerror(errno));
+	goto out;
+    }
+    if ((entries = st.st_size / sizeof(struct tIndex)) <= 0) {
+	esyslog("Empty index.vdr");
+	goto out;
+    }
+    if (!(index = (struct tIndex*)malloc(entries * sizeof(struct tIndex)))) {
+	esyslog("cut: can not alloc memory (%s)", strerror(errno));
+	goto out;
+    }
+    if (read(fd, index, entries * sizeof(struct tIndex)) != (ssize_t)(entries * sizeof(struct tIndex))) {
+	esyslog("Couldn't read index.vdr: %s", strerror(errno));
+	goto out;
+    }
+
+    if (!(fp = fopen(marks, "r"))) {
+	esyslog("Couldn't open file %s: %s", marks, strerror(errno));
+	goto out;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+	if (line[0] < '0' || line[0] > '9')
+	    continue;
+	if (count >= max) {
+	    long *tmp = (long*)realloc(frame, (max += 32) * sizeof(long));
+	    if (!tmp) {
+		esyslog("cut: can not alloc memory (%s)", strerror(errno));
+		fclose(fp);
+		goto out;
+	    }
+	    frame = tmp;
+	}
+	frame[count++] = HMSFToIndex(line);
+    }
+    fclose(fp);
+    if (!count) {
+	esyslog("No marks found in %s", marks);
+	goto out;
+    }
+
+    if (strcmp(output, "-") &&
+	(out = open(output, O_WRONLY|O_CREAT|O_TRUNC|O_NOCTTY, 0644)) < 0) {
+	esyslog("Couldn't open file %s: %s", output, strerror(errno));
+	goto out;
+    }
+    passmode = copymode(out);
+
+    for (int m = 0; m < count; m += 2) {	// Pairs of begin and end mark
+	const long b = iframe(index, entries, frame[m]);
+	const long e = (m + 1 < count) ? iframe(index, entries, frame[m+1] + 1) : entries;
+	if (b >= e)
+	    continue;
+	if (span(index, entries, b, e, out) < 0)
+	    goto out;
+    }
+    ret = 0;
+out:
+    if (out != STDOUT_FILENO && out >= 0)
+	close(out);
+    if (fd >= 0)
+	close(fd);
+    if (frame)
+	free(frame);
+    if (index)
+	free(index);
+    return ret;
+}
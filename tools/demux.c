@@ -0,0 +1,221 @@
+/*
+ * demux.c:	Walk once over the packs and PES packets of a program
+ *		stream and hand each packet to a list of consumers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ * Copyright (C) 2003-2005 Werner Fink, <werner@suse.de>
+ *
+ * Also used:
+ * the documentation found at http://mpucoder.kewlhair.com/DVD/
+ */
+
+#include <string.h>
+#include "demux.h"
+
+static inline uint_64 timestamp(const uint_8 *p)
+{
+    return ((((uint_64)p[0] & 0x0e) << 29) |
+	     ((uint_64)p[1]	    << 22) |
+	    (((uint_64)p[2] & 0xfe) << 14) |
+	     ((uint_64)p[3]	    <<  7) |
+	     ((uint_64)p[4]	    >>  1));
+}
+
+//
+// Move to the next start code 0x00 0x00 0x01, the memory window
+// is searched for the 0x01 with memchr(3).
+//
+static bool startcode(cHandle &handle)
+{
+    size_t n;
+
+    while ((n = handle.len()) >= 4) {
+	const uint_8 *const p = handle(n);
+	const uint_8 *const e = p + n - 1;	// Keep the stream id within window
+	const uint_8 *s = p + 2;
+
+	while (s < e && (s = (const uint_8 *)memchr(s, 0x01, e - s))) {
+	    if (!s[-1] && !s[-2]) {
+		handle.skip(s - 2 - p);
+		return true;
+	    }
+	    s++;
+	}
+	handle.skip(n - 3);			// Keep last three bytes
+    }
+    return false;
+}
+
+//
+// Parse the header of a PES packet, the whole packet is
+// within the memory window.
+//
+inline void cDemux::header(pes_t &pes)
+{
+    const uint_8 *p = pes.data + 6;
+    const uint_8 *const e = pes.data + pes.len;
+
+    switch (pes.stream) {
+    case 0xbc:				// Program Stream Map
+    case 0xbe:				// Padding stream
+    case 0xbf:				// Private stream 2
+    case 0xf0 ... 0xf2:			// ECM, EMM, DSM CC stream
+    case 0xf8:				// ITU-T Rec. H.222.1 type E
+    case 0xff:				// Program Stream Directory
+	goto out;			// No PES header
+    default:
+	break;
+    }
+
+    if ((*p & 0xc0) == 0x80) {		// MPEG-2
+	const uint_8 *const h = p;
+	if (p + 3 > e || p + 3 + p[2] > e)
+	    goto bad;
+	if (h[0] & 0x04)
+	    pes.flags |= DEMUX_F_ALIGNED;
+	if (h[1] & 0x80)
+	    pes.pts = timestamp(&h[3]);
+	if ((h[1] & 0xc0) == 0xc0)
+	    pes.dts = timestamp(&h[8]);
+	p += 3 + h[2];
+    } else {				// MPEG-1
+	pes.flags |= DEMUX_F_MPEG1;
+	while (p < e && *p == 0xff)	// Stuffing
+	    p++;
+	if (p < e && (*p & 0xc0) == 0x40)	// STD buffer
+	    p += 2;
+	if (p >= e)
+	    goto bad;
+	switch (*p & 0xf0) {
+	case 0x20:
+	    if (p + 5 > e)
+		goto bad;
+	    pes.pts = timestamp(p);
+	    p += 5;
+	    break;
+	case 0x30:
+	    if (p + 10 > e)
+		goto bad;
+	    pes.pts = timestamp(p);
+	    pes.dts = timestamp(p + 5);
+	    p += 10;
+	    break;
+	default:
+	    if (*p != 0x0f)
+		goto bad;
+	    p++;
+	    break;
+	}
+    }
+
+    if (pes.stream == 0xbd && p < e && !(pes.flags & DEMUX_F_MPEG1))
+	pes.sub = *p;
+out:
+    pes.payload = p;
+    pes.size = e - p;
+    return;
+bad:
+    errors++;
+    pes.pts = pes.dts = DEMUX_NOTS;
+    p = e;
+    goto out;
+}
+
+bool cDemux::Add(cConsumer *c)
+{
+    if (consumers >= DEMUX_MAX)
+	return false;
+    consumer[consumers++] = c;
+    return true;
+}
+
+void cDemux::Scan(cHandle &handle)
+{
+    number++;
+    for (int i = 0; i < consumers; i++)
+	consumer[i]->Begin(number);
+
+    foreach(handle) {
+	const uint_8 *p;
+	uint_32 w;
+	pes_t pes;
+
+	if (!startcode(handle))
+	    break;
+	p = handle(4);
+
+	memset(&pes, 0, sizeof(pes_t));
+	pes.offset = handle.Offset();
+	pes.pts = pes.dts = DEMUX_NOTS;
+	pes.stream = p[3];
+
+	switch (pes.stream) {
+	case 0xb9:			// Program end
+	    w = 4;
+	    break;
+	case 0xba:			// Pack header
+	    p = handle(14);
+	    if ((p[4] >> 6) == 1) {
+		pes.pts = ((((uint_64)p[4] & 0x38) << 27) |
+			   (((uint_64)p[4] & 0x03) << 28) |
+			    ((uint_64)p[5]	   << 20) |
+			   (((uint_64)p[6] & 0xf8) << 12) |
+			   (((uint_64)p[6] & 0x03) << 13) |
+			    ((uint_64)p[7]	   <<  5) |
+			    ((uint_64)p[8]	   >>  3));
+		w = 14 + (p[13] & 0x07);
+	    } else if ((p[4] >> 4) == 2) {
+		pes.flags |= DEMUX_F_MPEG1;
+		pes.pts = timestamp(&p[4]);
+		w = 12;
+	    } else {
+		errors++;
+		handle.skip(1);
+		continue;
+	    }
+	    break;
+	case 0xbb ... 0xff:		// System header and PES packets
+	    p = handle(6);
+	    w = ((p[4] << 8) | p[5]) + 6;
+	    break;
+	default:			// Not at a packet, resync
+	    errors++;
+	    handle.skip(1);
+	    continue;
+	}
+
+	if (!(p = handle(w)))
+	    break;
+	pes.data = p;
+	pes.len  = w;
+	pes.payload = p + w;
+	if (pes.stream > 0xbb)
+	    header(pes);
+
+	packets++;
+	for (int i = 0; i < consumers; i++)
+	    consumer[i]->Packet(pes);
+
+	handle.skip(w);
+    } end(handle);
+}
+
+void cDemux::Done(void)
+{
+    for (int i = 0; i < consumers; i++)
+	consumer[i]->Done();
+}
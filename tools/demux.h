@@ -0,0 +1,104 @@
+/*
+ * demux.h:	Walk once over the packs and PES packets of a program
+ *		stream and hand each packet to a list of consumers
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ * Copyright (C) 2003-2005 Werner Fink, <werner@suse.de>
+ */
+
+#ifndef __DEMUX_H
+#define __DEMUX_H
+
+#include "handle.h"
+
+//
+// The memory window of the handle has to cover the largest
+// packet, that is 6 bytes of start code and length plus 65535
+// bytes.  The step size of dynamic buffers is rounded up to
+// whole pages for O_DIRECT.
+//
+#define DEMUX_STEPSIZE	(17*4096)
+#define DEMUX_MAX	8		// Consumers per demultiplexer
+
+#define DEMUX_NOTS	(~0ULL)		// No PTS or DTS
+
+//
+// Flags of a packet
+//
+#define DEMUX_F_ALIGNED	0x01		// Data alignment indicator
+#define DEMUX_F_MPEG1	0x02		// MPEG-1 pack or packet
+
+//
+// One pack header, system header, or PES packet.  All pointers
+// point into the memory window of the handle and are valid only
+// during the call of cConsumer::Packet().
+//
+typedef struct _pes {
+    uint_64 offset;			// Absolute offset of 00 00 01 <stream>
+    uint_64 pts;			// 90kHz, for packs the system clock
+					// reference base, DEMUX_NOTS if not available
+    uint_64 dts;			// 90kHz, DEMUX_NOTS if not available
+    const uint_8 *data;			// Whole packet
+    const uint_8 *payload;		// Contents after the PES header
+    uint_32 len;			// Length of the whole packet
+    uint_32 size;			// Length of the payload
+    uint_8  stream;			// Stream id, 0xba for packs
+    uint_8  sub;			// Sub stream id of private stream 1
+    uint_8  flags;			// DEMUX_F_*
+} pes_t;
+
+//
+// Interface of the consumers, Begin() is called at the start of
+// each file with its number counted from 1, Done() after the last
+// file.
+//
+class cConsumer {
+public:
+    virtual ~cConsumer() {};
+    virtual void Begin(const int number) {};
+    virtual void Packet(const pes_t &pes) = 0;
+    virtual void Done(void) {};
+};
+
+class cDemux {
+private:
+    cConsumer * consumer[DEMUX_MAX];
+    int consumers;
+    int number;
+    uint_64 packets;
+    uint_64 errors;
+    inline void header(pes_t &pes);
+public:
+    cDemux() : consumers(0), number(0), packets(0), errors(0) {};
+	//
+	// Register a consumer, the demultiplexer does not own it
+	//
+    bool Add(cConsumer *c);
+	//
+	// Walk over the stream of the handle, the handle is not
+	// copied to keep the read ahead thread of the caller.
+	//
+    void Scan(cHandle &handle);
+	//
+	// Tell the consumers that the last stream was scanned
+	//
+    void Done(void);
+    const uint_64 Packets(void) const { return packets; };
+    const uint_64 Errors(void)  const { return errors; };
+};
+
+#endif // __DEMUX_H
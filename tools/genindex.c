@@ -1,7 +1,7 @@
 /*
  * genindex.c	generates index.vdr file from mpeg files written by VDR
  *
- * Compile:	gcc -o genindex -O2 -Wall -funroll-loops genindex.c
+ * Compile:	g++ -o genindex -O2 -Wall -funroll-loops genindex.c handle.c -lpthread
  *
  * Authors:	varies, including me (Werner Fink <werner@suse.de>)
  *
@@ -13,17 +13,41 @@
  *   buffers for ringbuffer and stdio to lower I/O load and increase
  *   speed.	//werner
  *
+ *   Mon Oct 19, 2026: Use the memory mapped reader of cHandle
+ *   instead of fseek/fread for each byte outside of the ring buffer.
+ *   Search start codes with memchr(3) and jump over the payload of
+ *   all non video packets and over the rest of video packets after
+ *   the picture start code.
+ *
+ *   Mon Oct 19, 2026: Split the files into chunks of 64 MB, scan
+ *   them on a pool of threads (-j, default number of processors)
+ *   and merge the index entries in order.  Add the update mode
+ *   resuming at the last entry of index.vdr, and the follow mode
+ *   with inotify for ongoing recordings.
+ *
  * Usage:
  *
  *   cd /video[<number>]/<Film>/<Title>/<date>.<time>.<prio>.<life>.rec/
  *   [mv -f index.vdr index.vdr.bak]
- *   [pathto/]genindex
+ *   [pathto/]genindex [-u] [-f] [-j jobs]
+ *
+ *   -u  update an existing index.vdr, append only entries behind
+ *       its last entry
+ *   -f  like -u and follow a growing recording until it was not
+ *       changed for a minute
+ *   -j  number of threads
  */
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+#include "handle.h"
 
+#define STEP_SIZE	4096
 #define BUFFER_SIZE	4096*128
 
 #define SC_PICTURE	0x00
@@ -54,151 +78,591 @@
 /* VDR supports only offset with sizeof(int) */
 struct tIndex {int offset; unsigned char type; unsigned char number; short reserved; };
 
-static FILE* fp;
+/*
+ * Each file is split into chunks scanned in parallel.  A chunk
+ * collects the index entries of all packets starting within its
+ * range, the chain of packets is started at a plausible packet
+ * start (from) and followed up to the first packet start behind
+ * the chunk (next).  Chunk zero is started at the file begin.
+ */
+#ifndef CHUNK_SIZE
+#define CHUNK_SIZE	(64*1024*1024)
+#endif
+typedef struct _chunk {
+    unsigned char number;		/* File number */
+    long filesize;
+    long origin;			/* Known packet start of file */
+    long start, end;			/* Range of packet starts */
+    long from;				/* First packet start of chain */
+    long next;				/* First packet start behind end */
+    int stop;				/* Truncated packet, end of file */
+    int errors;				/* Broken packets */
+    int failed;
+    struct tIndex *entry;
+    size_t count, max;
+} chunk_t;
+
+/*
+ * Seconds without any change of the recording until the follow
+ * mode ends, e.g. as VDR has finished the recording.
+ */
+#ifndef FOLLOW_IDLE
+#define FOLLOW_IDLE	60
+#endif
+
 static FILE* idx;
-static long Foffset;
-static char fname[20];
-static unsigned char fbuffer[BUFFER_SIZE];
+static struct tIndex last;		/* Last entry of index.vdr */
+static chunk_t *chunks;
+static int nchunks;
+static int nextchunk;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
-static unsigned char buf(long p)
+/*
+ * Move to the next start code 0x00 0x00 0x01, the memory window
+ * is searched for the 0x01 with memchr(3) which is vectorized in
+ * the C library.  For memory mapped files the window is the whole
+ * rest of the file.
+ */
+static bool startcode(cHandle &handle)
 {
-    static unsigned char ringbuf[BUFFER_SIZE];
+    size_t n;
+
+    while ((n = handle.len()) >= 3)
+    {
+	const uint_8 *const p = handle(n);
+	const uint_8 *const e = p + n;
+	const uint_8 *s = p + 2;
+
+	while ((s = (const uint_8 *)memchr(s, 0x01, e - s)))
+	{
+	    if (!s[-1] && !s[-2])
+	    {
+		handle.skip(s - 2 - p);
+		return true;
+	    }
+	    s++;
+	}
+	handle.skip(n - 2);					/* Keep last two bytes */
+    }
+    return false;
+}
 
-    if ((p >= Foffset) && (p < (Foffset + BUFFER_SIZE)))
-	return ringbuf[p-Foffset];
+/*
+ * Search the picture start code of an I, P, or B frame before
+ * the absolute offset l, returns the picture type.
+ */
+static uint_8 picture(cHandle &handle, const long l)
+{
+    size_t n;
 
-    Foffset = p;
-    if (fseek(fp, p, SEEK_SET) == 0)
+    while (((long)handle.Offset() < l) && ((n = handle.len()) >= 6))
     {
-	size_t n = 0;
+	const uint_8 *const p = handle(n);
+	size_t lim = n - 5;					/* Type byte within window */
+	const uint_8 *s = p + 2, *e;
 
-	memset(&ringbuf, 0, sizeof(ringbuf));
-	n = fread(ringbuf, 1, sizeof(ringbuf), fp);
+	if (lim > (size_t)(l - (long)handle.Offset()))
+	    lim = (size_t)(l - (long)handle.Offset());
+	e = p + lim + 2;
 
-	if ((n < sizeof(ringbuf)) && ferror(fp))
+	while ((s < e) && (s = (const uint_8 *)memchr(s, 0x01, e - s)))
 	{
-	    fprintf(stderr, "Could not read from %s: %s\n", fname, strerror(errno));
-	    exit(1);
+	    if (!s[-1] && !s[-2] && s[1] == SC_PICTURE)
+	    {
+		const uint_8 Ptype = (s[3]>>3) & 0x07;
+		if ((Ptype == I_FRAME) || (Ptype == P_FRAME) || (Ptype == B_FRAME))
+		    return Ptype;
+	    }
+	    s++;
 	}
+	handle.skip(lim);
+    }
+    return NO_PICTURE;
+}
+
+static int add(chunk_t *chunk, const long c, const uint_8 Ptype)
+{
+    /* VDR supports only offset with sizeof(int) */
+    const struct tIndex i = {(int)c, Ptype, chunk->number, 0};
 
-	return ringbuf[p-Foffset];
+    if (chunk->count >= chunk->max)
+    {
+	const size_t max = chunk->max ? 2*chunk->max : 1024;
+	struct tIndex *entry = (struct tIndex *)realloc(chunk->entry, max*sizeof(struct tIndex));
+	if (!entry)
+	    return -1;
+	chunk->entry = entry;
+	chunk->max = max;
     }
+    chunk->entry[chunk->count++] = i;
     return 0;
 }
 
-static int readfile(const unsigned char number)
-{ 
-    long filesize;
-    long c = 0;
+/*
+ * A start code found in the middle of a file is only accepted as
+ * packet start if the stream id is known and, if visible in the
+ * memory window, the next packet starts where the length says.
+ */
+static bool plausible(const uint_8 *p, const size_t n, const long w)
+{
+    switch (p[3])
+    {
+	case PROG_STREAM_MAP:
+	case PRIVATE_STREAM2:
+	case PROG_STREAM_DIR:
+	case ECM_STREAM     :
+	case EMM_STREAM     :
+	case PADDING_STREAM :
+	case DSM_CC_STREAM  :
+	case ISO13522_STREAM:
+	case PRIVATE_STREAM1:
+	case AUDIO_STREAM_S ... AUDIO_STREAM_E:
+	case VIDEO_STREAM_S ... VIDEO_STREAM_E:
+	    break;
+	default:
+	    return false;
+    }
+    if (n < (size_t)w + 4)
+	return true;
+    return (!p[w] && !p[w+1] && p[w+2] == 0x01 && p[w+3] >= PROG_STREAM_MAP);
+}
+
+/*
+ * Scan the chunk starting at the absolute offset base of the file
+ * the handle was opened at.  If forced, base is known to be the
+ * start of the chain of packets.
+ */
+static void scan(cHandle &handle, chunk_t *chunk, const long base, const bool forced)
+{
+    const long filesize = chunk->filesize;
 
-    sprintf(fname,"%03d.vdr", number);
-    fp = fopen(fname, "r");
-    if (!fp)
+    chunk->from = forced ? base : -1;
+    chunk->next = filesize;
+
+    foreach(handle)
     {
-	if (errno != ENOENT)
+	const uint_8 *p;
+	long c, w, l;
+	size_t n;
+
+	if (!startcode(handle))
+	    break;						/* while handle */
+
+	c = base + (long)handle.Offset();
+	if (c >= chunk->end)
 	{
-	    fprintf(stderr, "Could not open %s: %s\n", fname, strerror(errno));
-	    return -1;
+	    chunk->next = c;
+	    break;						/* while handle */
 	}
-	putchar('\n');
-	return 1;
-    }
-    setbuffer(fp, (char *__restrict__)fbuffer, sizeof(fbuffer));
-    if (fseek(fp, 0, SEEK_END) < 0)
+
+	n = handle.len();
+	p = handle(6);
+	w = ((p[4] << 8) | p[5]) + 6;				/* width of frame */
+	l = w + c;						/* absolute length */
+
+	if (chunk->from < 0)
+	{
+	    if (!plausible(p, n, w))
+	    {
+		handle.skip(1);
+		continue;					/* while handle */
+	    }
+	    chunk->from = c;
+	}
+
+	if (!((l > c) && (l <= filesize)))
+	{
+	    chunk->stop = 1;
+	    break;						/* while handle */
+	}
+
+	switch (p[3])						/* streamid */
+	{
+	    case PROG_STREAM_MAP:
+	    case PRIVATE_STREAM2:
+	    case PROG_STREAM_DIR:
+	    case ECM_STREAM     :
+	    case EMM_STREAM     :
+	    case PADDING_STREAM :
+	    case DSM_CC_STREAM  :
+	    case ISO13522_STREAM:
+	    case PRIVATE_STREAM1:
+	    case AUDIO_STREAM_S ... AUDIO_STREAM_E:
+		break;						/* Jump over payload */
+	    case VIDEO_STREAM_S ... VIDEO_STREAM_E:
+		{
+		    const long off = (handle(9)[8] + 9);	/* offset of frame contents */
+		    uint_8 Ptype;
+
+		    if (off >= w)
+			break;
+		    handle.skip(off);
+		    if ((Ptype = picture(handle, l - base)) == NO_PICTURE)
+			break;
+		    if (add(chunk, c, Ptype) < 0)
+		    {
+			chunk->failed = ENOMEM;
+			return;
+		    }
+		}
+		break;
+	    default:
+		chunk->errors++;
+		break;
+	}							/* switch streamid */
+	handle.skip(l - base - (long)handle.Offset());		/* Next frame */
+    }								/* while handle */
+    end(handle);
+}
+
+static void scanchunk(chunk_t *chunk, uint_8 *buf, const long base, const bool forced)
+{
+    char fname[20];
+    int fd;
+
+    chunk->count = 0;
+    chunk->stop = chunk->errors = chunk->failed = 0;
+
+    sprintf(fname,"%03d.vdr", chunk->number);
+    if ((fd = open(fname, O_RDONLY|O_NOCTTY)) < 0)
     {
-	fprintf(stderr, "Could not goto end of %s: %s\n", fname, strerror(errno));
-	return -1;
+	chunk->failed = errno;
+	return;
     }
-    if ((filesize = ftell(fp)) < 0)
+    if (lseek(fd, base, SEEK_SET) == base)
     {
-	fprintf(stderr, "Could not get size of %s: %s\n", fname, strerror(errno));
-	return -1;
+	cHandle handle(buf, BUFFER_SIZE+STEP_SIZE, STEP_SIZE, fd);	/* Memory mapped if possible */
+	scan(handle, chunk, base, forced);
     }
+    else
+	chunk->failed = errno;
+    close(fd);
+}
 
-    if (number > 1)
-	putchar('\n');
-    printf("Reading %s, %ld kB.\n", fname, (filesize >> 10));
-    Foffset = filesize;
+static void *worker(void *arg)
+{
+    uint_8 *buf = (uint_8 *)malloc(BUFFER_SIZE+STEP_SIZE);
+    int k;
+
+    while (true)
+    {
+	pthread_mutex_lock(&mutex);
+	k = nextchunk++;
+	pthread_mutex_unlock(&mutex);
+	if (k >= nchunks)
+	    break;
+	if (!buf)
+	{
+	    chunks[k].failed = ENOMEM;
+	    continue;
+	}
+	scanchunk(&chunks[k], buf, chunks[k].start, (chunks[k].start == chunks[k].origin));
+    }
+    if (buf)
+	free(buf);
+    return NULL;
+}
 
-    rewind(fp); /* Even if done for p == 0 in buf() */
+/*
+ * Split all files into chunks, stops at the first missing file.
+ * For an update, the file of the last index entry is split from
+ * the offset of that entry.
+ */
+static int split(void)
+{
+    unsigned char number;
+    long origin = 0;
+    int max = 0;
 
-    while (c < filesize)
+    number = 1;
+    if (last.number)
     {
-	if (buf(c) == 0x00 && buf(c+1) == 0x00 && buf(c+2) == 0x01)
+	number = last.number;
+	origin = last.offset;
+    }
+    for (; number; number++, origin = 0)
+    {
+	struct stat st;
+	char fname[20];
+	long start;
+
+	sprintf(fname,"%03d.vdr", number);
+	if (stat(fname, &st) < 0)
 	{
-	    const long w = ((buf(c+4) << 8) | buf(c+5)) + 6;	/* width of frame */
-	    const long l = w + c;				/* absolute length */
+	    if (errno != ENOENT)
+	    {
+		fprintf(stderr, "Could not open %s: %s\n", fname, strerror(errno));
+		return -1;
+	    }
+	    break;
+	}
+	if (origin >= (long)st.st_size)
+	    continue;
+	start = origin;
+	do {
+	    if (nchunks >= max)
+	    {
+		chunk_t *c;
+		max += 256;
+		if (!(c = (chunk_t *)realloc(chunks, max*sizeof(chunk_t))))
+		{
+		    fprintf(stderr, "Could not allocate memory: %s\n", strerror(errno));
+		    return -1;
+		}
+		chunks = c;
+	    }
+	    memset(&chunks[nchunks], 0, sizeof(chunk_t));
+	    chunks[nchunks].number = number;
+	    chunks[nchunks].filesize = (long)st.st_size;
+	    chunks[nchunks].origin = origin;
+	    chunks[nchunks].start = start;
+	    /* Pipes and sockets can not be split */
+	    if (!S_ISREG(st.st_mode) || (long)st.st_size - start <= CHUNK_SIZE)
+		chunks[nchunks].end = (long)st.st_size;
+	    else
+		chunks[nchunks].end = start + CHUNK_SIZE;
+	    start = chunks[nchunks].end;
+	    nchunks++;
+	} while (start < (long)st.st_size);
+    }
+    return 0;
+}
+
+/*
+ * Write the index entries of the chunks in order.  If the chain
+ * of packets of the previous chunk does not meet the start of the
+ * chain of a chunk, this chunk is scanned again.
+ */
+static int merge(void)
+{
+    uint_8 *buf = NULL;
+    long pos = 0;
+    int k;
+
+    for (k = 0; k < nchunks; k++)
+    {
+	chunk_t *const chunk = &chunks[k];
+	char fname[20];
+	size_t i;
+	int e;
 
-	    if (!((l > c) && (l <= filesize)))
-		break;						/* while c < filesize */
+	sprintf(fname,"%03d.vdr", chunk->number);
+	if (chunk->start == chunk->origin)
+	{
+	    if (k > 0)
+		putchar('\n');
+	    printf("Reading %s, %ld kB.\n", fname, (chunk->filesize >> 10));
+	    pos = chunk->origin;
+	}
+	if (pos >= chunk->end)
+	    continue;
+	if (chunk->from != pos && !chunk->failed)
+	{
+	    if (!buf && !(buf = (uint_8 *)malloc(BUFFER_SIZE+STEP_SIZE)))
+		chunk->failed = ENOMEM;
+	    else
+		scanchunk(chunk, buf, pos, true);
+	}
+	if (chunk->failed)
+	{
+	    fprintf(stderr, "\nCould not read from %s: %s\n", fname, strerror(chunk->failed));
+	    goto err;
+	}
 
-	    switch (buf(c+3))					/* streamid */
+	for (i = 0; i < chunk->count; i++)
+	{
+	    if (chunk->entry[i].number == last.number && chunk->entry[i].offset <= last.offset)
+		continue;					/* Already in index.vdr */
+	    if (fwrite(&chunk->entry[i], 1, sizeof(struct tIndex), idx) != sizeof(struct tIndex))
 	    {
-		case PROG_STREAM_MAP:
-		case PRIVATE_STREAM2:
-		case PROG_STREAM_DIR:
-		case ECM_STREAM     :
-		case EMM_STREAM     :
-		case PADDING_STREAM :
-		case DSM_CC_STREAM  :
-		case ISO13522_STREAM:
-		case PRIVATE_STREAM1:
-		case AUDIO_STREAM_S ... AUDIO_STREAM_E:
-		    break;
-		case VIDEO_STREAM_S ... VIDEO_STREAM_E:
-		    {
-			long off = (buf(c+8) + 9) + c;		/* absolute offset of frame contents */
-			for (;off < l; off++)
-			{
-			    if (buf(off) == 0x00 && buf(off+1) == 0x00 && buf(off+2) == 0x01 &&
-				buf(off+3) == SC_PICTURE)
-			    {
-				const unsigned char Ptype = (buf(off+5)>>3) & 0x07;
-				if ((Ptype == I_FRAME) || (Ptype == P_FRAME) || (Ptype == B_FRAME))
-				{
-				    /* VDR supports only offset with sizeof(int) */
-				    const struct tIndex i = {(int)c, Ptype, number, 0};
-
-				    if (fwrite(&i, 1, sizeof(i), idx) != sizeof(i))
-				    {
-					fprintf(stderr, "Error writing index file: %s\n", strerror(errno));
-					return -1;
-				    }
-				    if (Ptype == I_FRAME)
-				    {
-					printf("I-Frame found at %ld kB\r", (c >> 10));
-					fflush(stdout);
-				    }
-				    break;			/* while off < l */
-				}				/* if Ptype == I_FRAME ... */
-			    }					/* if buf(off) == 0x00 ... */
-			}					/* while off < l */
-		    }
-		    break;
-		default:
-		    fprintf(stderr, "\nError while scanning file %s, broken mpeg file?\n", fname);
-		    break;
-	    }							/* switch buf(c+3) */
-	    c += w;						/* Next frame */
+		fprintf(stderr, "Error writing index file: %s\n", strerror(errno));
+		goto err;
+	    }
+	    last = chunk->entry[i];
+	    if (chunk->entry[i].type == I_FRAME)
+	    {
+		printf("I-Frame found at %ld kB\r", ((long)chunk->entry[i].offset >> 10));
+		fflush(stdout);
+	    }
 	}
-	else							/* if buf(c) == 0x00 ... */
-	    c++;						/* Broken file, search for begin */
-    }								/* while c < filesize */
-    fclose(fp);
+	for (e = 0; e < chunk->errors; e++)
+	    fprintf(stderr, "\nError while scanning file %s, broken mpeg file?\n", fname);
+
+	pos = chunk->stop ? chunk->filesize : chunk->next;
+    }
+    putchar('\n');
+    if (buf)
+	free(buf);
+    fflush(idx);
+    return 0;
+err:
+    if (buf)
+	free(buf);
+    return -1;
+}
+
+/*
+ * Read the last entry of an existing index.vdr, an incomplete
+ * entry at the end is removed.  New entries are appended.
+ */
+static int lastentry(void)
+{
+    long size;
+
+    if (fseek(idx, 0, SEEK_END) < 0 || (size = ftell(idx)) < 0)
+	goto err;
+    if (size % sizeof(struct tIndex))
+    {
+	size -= size % sizeof(struct tIndex);
+	if (ftruncate(fileno(idx), size) < 0)
+	    goto err;
+    }
+    if (size > 0)
+    {
+	if (fseek(idx, size - sizeof(struct tIndex), SEEK_SET) < 0)
+	    goto err;
+	if (fread(&last, 1, sizeof(struct tIndex), idx) != sizeof(struct tIndex))
+	    goto err;
+	printf("Resume %03d.vdr at %d kB.\n", last.number, (last.offset >> 10));
+    }
+    if (fseek(idx, size, SEEK_SET) < 0)
+	goto err;
     return 0;
+err:
+    fprintf(stderr, "Could not read index.vdr: %s\n", strerror(errno));
+    return -1;
+}
+
+/*
+ * Scan all new packets and append the entries to index.vdr
+ */
+static int update(long jobs)
+{
+    pthread_t *threads;
+    int k, n, ret;
+
+    for (k = 0; k < nchunks; k++)
+	if (chunks[k].entry)
+	    free(chunks[k].entry);
+    nchunks = nextchunk = 0;
+
+    ret = split();
+    if (jobs > nchunks)
+	jobs = nchunks;
+
+    if (!(threads = (pthread_t *)malloc((jobs ? jobs : 1)*sizeof(pthread_t))))
+	jobs = 0;
+    for (n = 0; n < jobs; n++)
+	if (pthread_create(&threads[n], NULL, worker, NULL) != 0)
+	    break;
+    if (n == 0)
+	worker(NULL);						/* No threads at all */
+    while (n-- > 0)
+	pthread_join(threads[n], NULL);
+    if (threads)
+	free(threads);
+
+    if (merge() < 0)
+	ret = -1;
+    return ret;
+}
+
+/*
+ * Update the index on every change of the recording directory
+ * until nothing has changed for FOLLOW_IDLE seconds.
+ */
+static int follow(long jobs)
+{
+    char events[4096];
+    int fd, ret = -1;
+
+    if ((fd = inotify_init()) < 0)
+    {
+	fprintf(stderr, "Could not initialize inotify: %s\n", strerror(errno));
+	goto out;
+    }
+    if (inotify_add_watch(fd, ".", IN_MODIFY|IN_CREATE|IN_CLOSE_WRITE|IN_MOVED_TO) < 0)
+    {
+	fprintf(stderr, "Could not watch recording: %s\n", strerror(errno));
+	goto out;
+    }
+    while (true)
+    {
+	struct timeval tv = { FOLLOW_IDLE, 0 };
+	fd_set watch;
+	int n;
+
+	FD_ZERO(&watch);
+	FD_SET(fd, &watch);
+	if ((n = select(fd+1, &watch, (fd_set*)0, (fd_set*)0, &tv)) < 0)
+	{
+	    if (errno == EINTR)
+		continue;
+	    break;
+	}
+	if (n == 0)
+	{
+	    ret = 0;						/* Recording finished */
+	    break;
+	}
+	if (read(fd, events, sizeof(events)) < 0 && errno != EINTR)
+	    break;
+	usleep(200000);						/* Collect more writes */
+	if (update(jobs) < 0)
+	    break;
+    }
+out:
+    if (fd >= 0)
+	close(fd);
+    return ret;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: genindex [-u] [-f] [-j jobs]\n");
 }
 
-int main()
+int main(int argc, char *argv[])
 {
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    bool resume = false, watch = false;
     int c, ret;
-    if (!(idx = fopen("index.vdr", "w")))
+
+    while ((c = getopt(argc, argv, "j:ufh")) > 0)
+    {
+	switch (c)
+	{
+	    case 'u':
+		resume = true;
+		break;
+	    case 'f':
+		resume = watch = true;
+		break;
+	    case 'j':
+		if ((jobs = strtol(optarg, NULL, 0)) > 0)
+		    break;
+	    default:
+		usage();
+		return 1;
+	}
+    }
+    if (jobs < 1)
+	jobs = 1;
+
+    if (!(idx = fopen("index.vdr", resume ? "a+" : "w")))
     {
 	fprintf(stderr, "Could not open index.vdr: %s\n", strerror(errno));
 	return -1;
     }
-    for (c=1; ((ret = readfile(c)) == 0); c++)
-	__asm__ __volatile__("": : :"memory");
+    if (resume && lastentry() < 0)
+    {
+	fclose(idx);
+	return 1;
+    }
+    ret = update(jobs);
+    if (ret == 0 && watch)
+	ret = follow(jobs);
     fclose(idx);
-    return (ret > 0 ? 0 : 1);
+    return (ret < 0 ? 1 : 0);
 }
 /* end of genindex.c */
@@ -30,8 +30,17 @@
 
 #include "handle.h"
 #include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
 
-inline bool cHandle::watch(unsigned long int ms)
+//
+// Read ahead of memory mapped files
+//
+#define MAP_AHEAD	(8*1024*1024)
+
+static bool watchfd(const int fd, unsigned long int ms)
 {
     fd_set watch;
     suseconds_t usec = ms*1000;
@@ -46,11 +55,196 @@ inline bool cHandle::watch(unsigned long int ms)
 	ret = select(fd+1, &watch, (fd_set*)0, (fd_set*)0, &tv);
     } while (ret < 0 && errno == EINTR);
 
-    if (tv.tv_usec == usec)
+    //
+    // Returned at once, e.g. regular file or closed pipe at end of
+    // stream.  Newer kernels account a few microseconds even then.
+    //
+    if (usec - tv.tv_usec < 1000)
 	ret = -1;
     return (ret > 0) ? FD_ISSET(fd, &watch) : false;
 }
 
+//
+// The read ahead thread fills the ring buffer of a dynamic cHandle
+// while the scanner consumes it.  All positions are absolute stream
+// positions, therefore copies of a cHandle may share one reader.
+// The last `keep' bytes consumed are not overwritten because the
+// copies returned by the postfix operator may still point to them.
+//
+class cReader {
+private:
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint_8 *const data;
+    const size_t size;
+    const size_t keep;
+    const size_t chunk;
+    const int fd;
+    int flags;
+    size_t align;			// Non zero for O_DIRECT
+    volatile uint_64 filled;		// Bytes read into the ring
+    volatile uint_64 released;		// Bytes which may be overwritten
+    volatile bool done;
+    volatile bool stop;
+    bool running;
+    size_t space(void);
+    void action(void);
+    static void *start(void *arg);
+public:
+    cReader(uint_8 *buf, const size_t len, const size_t step, const int file, const bool direct);
+    ~cReader();
+    inline bool Active(void) const { return running; };
+    size_t Ahead(const uint_64 pos, const size_t want);
+};
+
+cReader::cReader(uint_8 *buf, const size_t len, const size_t step, const int file, const bool direct)
+: data(buf), size(len), keep(step), chunk(len/8), fd(file), flags(-1), align(0),
+  filled(0), released(0), done(false), stop(false), running(false)
+{
+    static const size_t page = sysconf(_SC_PAGESIZE);
+    struct stat st;
+    off_t pos;
+
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+
+    if (!direct || ((unsigned long)data & (page-1)) || (size & (page-1)))
+	goto start;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+	goto start;		// Pipes know O_DIRECT as packet mode
+    if ((pos = lseek(fd, 0, SEEK_CUR)) < 0 || (pos & (page-1)))
+	goto start;
+    if ((flags = fcntl(fd, F_GETFL)) < 0)
+	goto start;
+    if (fcntl(fd, F_SETFL, flags|O_DIRECT) == 0)
+	align = page;		// Not all file systems support this
+start:
+    running = (pthread_create(&thread, NULL, start, this) == 0);
+}
+
+cReader::~cReader()
+{
+    if (running) {
+	pthread_mutex_lock(&mutex);
+	stop = true;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+	pthread_cancel(thread);		// May hang in read() on a pipe
+	pthread_join(thread, NULL);
+    }
+    if (align)
+	(void)fcntl(fd, F_SETFL, flags);
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+}
+
+void *cReader::start(void *arg)
+{
+    (void)pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    ((cReader *)arg)->action();
+    return NULL;
+}
+
+//
+// Free and continuous bytes at the fill position, small gaps are
+// skipped to get large reads.  Called with mutex locked.
+//
+size_t cReader::space(void)
+{
+    const size_t free = size - (size_t)(filled - released);
+    const size_t pos = (size_t)(filled % size);
+    size_t put = size - pos;
+
+    if (free < chunk)
+	return 0;
+    if (put > free)
+	put = free;
+    if (align)
+	put &= ~(align-1);
+    return put;
+}
+
+void cReader::action(void)
+{
+    size_t put = 0, pos = 0;
+    ssize_t real;
+
+    while (true) {
+	pthread_mutex_lock(&mutex);
+	while (!stop && !(put = space()))
+	    pthread_cond_wait(&cond, &mutex);
+	pos = (size_t)(filled % size);
+	pthread_mutex_unlock(&mutex);
+	if (stop)
+	    break;
+
+	(void)pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+	real = read(fd, data+pos, put);
+	(void)pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+	if (real < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno == EAGAIN) {
+		(void)watchfd(fd, 320);
+		continue;
+	    }
+	    if (errno == EINVAL && align) {
+		(void)fcntl(fd, F_SETFL, flags);
+		align = 0;	// Unaligned tail of the file
+		continue;
+	    }
+	    break;
+	}
+	if (real == 0) {
+	    if (watchfd(fd, 320))
+		continue;
+	    break;		// Nothing new, end of stream
+	}
+
+	pthread_mutex_lock(&mutex);
+	filled += real;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+    }
+
+    pthread_mutex_lock(&mutex);
+    done = true;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+}
+
+//
+// Release the ring up to `pos' and wait until at least `want'
+// bytes behind `pos' are read, returns the bytes available.
+//
+size_t cReader::Ahead(const uint_64 pos, const size_t want)
+{
+    const uint_64 rel = (pos > keep) ? pos - keep : 0;
+    size_t ret = 0;
+
+    pthread_mutex_lock(&mutex);
+    if (rel > released) {
+	released = rel;
+	pthread_cond_broadcast(&cond);
+    }
+    while (!done && (filled < pos + want))
+	pthread_cond_wait(&cond, &mutex);
+    if (filled > pos)
+	ret = (size_t)(filled - pos);
+    pthread_mutex_unlock(&mutex);
+
+    if (ret > size)
+	ret = size;
+    return ret;
+}
+
+inline bool cHandle::watch(unsigned long int ms)
+{
+    return watchfd(fd, ms);
+}
+
 void cHandle::refill(void) throw(cExeption)
 {
     size_t free;
@@ -84,6 +278,11 @@ void cHandle::refill(void) throw(cExeption)
     return;
 };
 
+inline void cHandle::ahead(const size_t want)
+{
+    avail = reader->Ahead(offset, (want > over) ? want : over);
+}
+
 inline void cHandle::rolling(const size_t pos)
 {
     ssize_t roll;
@@ -96,6 +295,53 @@ inline void cHandle::rolling(const size_t pos)
 	memcpy(data+size, data, roll);
 }
 
+inline bool cHandle::mapping(void)
+{
+    struct stat st;
+    off_t pos;
+    void *ptr;
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+	goto out;
+    if ((uint_64)st.st_size > (uint_64)(((size_t)~0) >> 1))
+	goto out;		// Does not fit into address space
+    if ((pos = lseek(fd, 0, SEEK_CUR)) < 0 || pos >= st.st_size)
+	goto out;
+
+    ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED)
+	goto out;
+    (void)madvise(ptr, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    map    = (uint_8 *)ptr;
+    mapped = (size_t)st.st_size;
+    data   = map;
+    size   = mapped;
+    over   = 0;
+    head   = (size_t)pos;
+    tail   = 0;
+    avail  = size - head;
+    curr   = data+head;
+    fd     = -1;		// Now we have a static buffer
+    advise();
+    return true;
+out:
+    return false;
+}
+
+inline void cHandle::advise(void)
+{
+    static const size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = head & ~(page-1);
+    size_t len = MAP_AHEAD;
+
+    if (start + len > mapped)
+	len = mapped - start;
+    if (len)
+	(void)madvise(map+start, len, MADV_WILLNEED);
+    advised = head + MAP_AHEAD/2;
+}
+
 void cHandle::movwin(const size_t len)
 {
     size_t  want, pos = head;
@@ -105,6 +351,8 @@ void cHandle::movwin(const size_t len)
 
     if ((fd >= 0) && (avail < size/2))
 	(void)refill();
+    else if (reader && (avail < size/2))
+	ahead(len);
 
     if (avail == 0)
 	goto out;
@@ -120,14 +368,30 @@ void cHandle::movwin(const size_t len)
     curr = data+head;
     avail -= want;
     offset += want;
+    if (map && head >= advised)
+	advise();
     out:
     return;
 };
 
+cHandle& cHandle::skip(uint_64 len)
+{
+    while (len) {
+	const uint_64 pos = offset;
+	movwin((over && (len > over)) ? over : (size_t)len);
+	if (offset == pos)
+	    break;		// End of data
+	len -= (offset - pos);
+    }
+    return *this;
+}
+
 bool cHandle::check(const size_t off) throw(cExeption)
 {
     if ((fd >= 0) && (avail < size/2))
 	(void)refill();
+    else if (reader && (avail < size/2))
+	ahead(off);
     left = avail;
     if (over) {
 	if (left > over)
@@ -139,14 +403,51 @@ bool cHandle::check(const size_t off) throw(cExeption)
     return true;
 }
 
-cHandle::cHandle(uint_8 *buf, size_t len, const size_t step, const int file)
-: data(buf), curr(data), size(len-step), over(step), fd(file), ex(1)
+cHandle::cHandle(uint_8 *buf, size_t len, const size_t step, const int file, const int mode)
+: data(buf), curr(data), size(len-step), over(step), fd(file), ex(1),
+  map(NULL), mapped(0), advised(0), owner(true), reader(NULL)
 {
     avail = head = tail = 0;
     offset = 0;
     if (fd < 0) {		// For static buffers we assume a filled buffer
 	tail  += size;
 	avail += size;
-    } else
-	(void)refill();
+	goto out;
+    }
+    if (!(mode & HANDLE_DIRECT) && mapping())
+	goto out;
+    if (mode & (HANDLE_ASYNC|HANDLE_DIRECT)) {
+	reader = new cReader(data, size, over, fd, (mode & HANDLE_DIRECT));
+	if (reader->Active()) {
+	    fd = -1;		// The reader owns the descriptor now
+	    ahead(over);
+	    goto out;
+	}
+	delete reader;
+	reader = NULL;
+    }
+    (void)refill();		// Pipes and sockets are read into the buffer
+out:
+    return;
+};
+
+cHandle::cHandle(const cHandle &orig)
+: offset(orig.offset), data(orig.data), curr(orig.curr), size(orig.size), over(orig.over),
+  fd(orig.fd), ex(orig.ex), map(orig.map), mapped(orig.mapped), advised(orig.advised),
+  owner(false), reader(orig.reader)
+{
+    left  = orig.left;
+    head  = orig.head;
+    tail  = orig.tail;
+    avail = orig.avail;
+};
+
+cHandle::~cHandle()
+{
+    if (!owner)
+	return;
+    if (map)
+	munmap(map, mapped);
+    if (reader)
+	delete reader;
 };
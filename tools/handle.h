@@ -50,6 +50,13 @@ typedef signed short   sint_16;
 typedef signed char    sint_8;
 #endif
 
+//
+// Modes of dynamic buffers: read ahead in a separate thread,
+// and read regular files with O_DIRECT to spare the page cache.
+//
+#define HANDLE_ASYNC	0x0001
+#define HANDLE_DIRECT	0x0002
+
 // Exeption class
 class cExeption {
 public:
@@ -57,22 +64,32 @@ public:
     cExeption(const int Reason) : reason(Reason) {};
 };
 
+class cReader;
+
 class cHandle {
 private:
     uint_64 offset;
-    uint_8 *const data;
+    uint_8 * data;
     uint_8 * curr;
-    const size_t size;
-    const size_t over;
+    size_t size;
+    size_t over;
     volatile size_t left;
     volatile size_t head;
     volatile size_t tail;
     volatile size_t avail;
     int fd;
     cExeption ex;
+    uint_8 * map;			// Memory mapped regular file
+    size_t mapped;
+    size_t advised;
+    bool owner;				// Copies do not unmap
+    cReader * reader;			// Read ahead thread
     inline bool watch(unsigned long int ms);
     void refill(void) throw(cExeption);
+    inline void ahead(const size_t want);
     inline void rolling(const size_t pos);
+    inline bool mapping(void);
+    inline void advise(void);
     void movwin(const size_t len);
     bool check(const size_t off) throw(cExeption);
 public:
@@ -81,9 +98,16 @@ public:
 	// or static buffer aready filled.  In case of a dynamic filter
 	// you may provide a minimal memory window step size to be able
 	// to ensure continues buffers from operators even if a buffer
-	// boundary is reached.
+	// boundary is reached.  Regular files are memory mapped, then
+	// the buffer is not used and all windows point into the map.
+	// Otherwise the buffer is filled by a read ahead thread while
+	// the windows are consumed, for HANDLE_DIRECT the buffer has
+	// to be page aligned.
 	//
-    cHandle(uint_8 *buf, size_t len, const size_t step = 0, const int file = -1);
+    cHandle(uint_8 *buf, size_t len, const size_t step = 0, const int file = -1,
+	    const int mode = HANDLE_ASYNC);
+    cHandle(const cHandle &orig);
+    virtual ~cHandle();
 	//
 	// Return current offset
 	//
@@ -147,6 +171,11 @@ public:
 	// position (x += o).
 	//
     inline cHandle& operator +=(const size_t& o) { movwin(o); return *this; };
+	//
+	// Skip o positions, also more than the step size
+	// e.g. the payload of a PES packet.
+	//
+    cHandle& skip(uint_64 o);
 	//
 	// Return current buffer position with at least
 	// o members included. Do not use any position
@@ -0,0 +1,187 @@
+/*
+ * passthru.c:	Copy unchanged runs of an input file to the output
+ *		without passing them through user space
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ * Copyright (C) 2003-2005 Werner Fink, <werner@suse.de>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "passthru.h"
+
+#define dsyslog(format, args...)	fprintf(stderr, "%s: " format "\n", program_invocation_short_name, ## args)
+#define esyslog(format, args...)	fprintf(stderr, "%s: " format "\n", program_invocation_short_name, ## args)
+
+int writeall(const int out, const uint_8 *buf, size_t len)
+{
+    while (len > 0) {
+	ssize_t n = write(out, buf, len);
+	if (n < 0) {
+	    if (errno == EINTR || errno == EAGAIN)
+		continue;
+	    esyslog("write() failed: %s", strerror(errno));
+	    return -1;
+	}
+	buf += n;
+	len -= n;
+    }
+    return 0;
+}
+
+int copyrange(const int in, loff_t from, size_t len, const int out, int &mode)
+{
+    static uint_8 *buf = NULL;
+
+    while (len > 0) {
+	ssize_t n = -1;
+
+	switch (mode) {
+	case PASS_RANGE:
+#ifdef __NR_copy_file_range
+	    n = syscall(__NR_copy_file_range, in, &from, out, NULL, len, 0);
+#else
+	    errno = ENOSYS;
+#endif
+	    break;
+	case PASS_SPLICE:
+#ifdef SPLICE_F_MOVE
+	    n = splice(in, &from, out, NULL, len, SPLICE_F_MOVE|SPLICE_F_MORE);
+#else
+	    errno = ENOSYS;
+#endif
+	    break;
+	default:
+	    if (!buf && !(buf = (uint_8*)malloc(PASS_BUFSIZE))) {
+		esyslog("copy: can not alloc memory (%s)", strerror(errno));
+		return -1;
+	    }
+	    if ((n = pread(in, buf, (len > PASS_BUFSIZE) ? PASS_BUFSIZE : len, (off_t)from)) <= 0)
+		break;
+	    if (writeall(out, buf, n) < 0)
+		return -1;
+	    from += n;
+	    break;
+	}
+
+	if (n < 0) {
+	    if (errno == EINTR || errno == EAGAIN)
+		continue;
+	    if (mode != PASS_BUFFER && (errno == EINVAL || errno == ENOSYS ||
+		errno == EXDEV || errno == EBADF || errno == EOPNOTSUPP)) {
+		dsyslog("copy: fall back to buffered copy (%s)", strerror(errno));
+		mode = PASS_BUFFER;
+		continue;
+	    }
+	    esyslog("copy: failed (%s)", strerror(errno));
+	    return -1;
+	}
+	if (n == 0) {
+	    esyslog("copy: unexpected end of file");
+	    return -1;
+	}
+	len -= n;
+    }
+    return 0;
+}
+
+int copymode(const int out)
+{
+    struct stat st;
+
+    if (fstat(out, &st) < 0)
+	goto out;
+    if (S_ISREG(st.st_mode)) {
+	int flags = fcntl(out, F_GETFL);
+	if (flags < 0)
+	    goto out;
+	if (flags & O_APPEND) {		// Refused by copy_file_range(2)
+	    if (lseek(out, 0, SEEK_END) < 0 ||
+		fcntl(out, F_SETFL, flags & ~O_APPEND) < 0)
+		goto out;
+	}
+	return PASS_RANGE;
+    }
+    if (S_ISFIFO(st.st_mode))
+	return PASS_SPLICE;
+out:
+    return PASS_BUFFER;
+}
+
+cPassThru::cPassThru(FILE *file, const char *name)
+: fp(file), in(-1), out(fileno(file)), mode(PASS_BUFFER), size(0), from(0), to(0)
+{
+    struct stat st;
+
+    if (!name)
+	goto out;
+    if ((in = open(name, O_RDONLY|O_NOCTTY)) < 0)
+	goto out;
+    if (fstat(in, &st) < 0 || !S_ISREG(st.st_mode)) {
+	close(in);
+	in = -1;
+	goto out;
+    }
+    size = st.st_size;
+    fflush(fp);
+    mode = copymode(out);
+out:
+    return;
+}
+
+cPassThru::~cPassThru()
+{
+    (void)Flush();
+    if (in >= 0)
+	close(in);
+}
+
+int cPassThru::Pass(const uint_64 offset, const size_t len)
+{
+    uint_64 end = offset + len;
+
+    if (end > size)
+	end = size;			// Truncated last packet
+    if (offset == to) {
+	to = end;
+	goto out;
+    }
+    if (Flush() < 0)
+	return -1;
+    from = offset;
+    to = end;
+out:
+    return 0;
+}
+
+int cPassThru::Flush(void)
+{
+    int ret = 0;
+
+    if (in < 0 || to <= from)
+	goto out;
+    fflush(fp);
+    ret = copyrange(in, (loff_t)from, (size_t)(to - from), out, mode);
+out:
+    from = to;
+    return ret;
+}
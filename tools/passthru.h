@@ -0,0 +1,85 @@
+/*
+ * passthru.h:	Copy unchanged runs of an input file to the output
+ *		without passing them through user space
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ * Copyright (C) 2003-2005 Werner Fink, <werner@suse.de>
+ */
+
+#ifndef __PASSTHRU_H
+#define __PASSTHRU_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "handle.h"
+
+//
+// Ways to copy from a regular file: copy_file_range(2) into
+// regular files, splice(2) into pipes, otherwise pread/write.
+//
+#define PASS_RANGE	0
+#define PASS_SPLICE	1
+#define PASS_BUFFER	2
+
+#define PASS_BUFSIZE	(1024*1024)	// Buffered copy if nothing else works
+
+//
+// Write all of buf to out, returns -1 on error
+//
+extern int writeall(const int out, const uint_8 *buf, size_t len);
+//
+// Copy len bytes at from of the regular file in to out with
+// the given way, the way falls back to PASS_BUFFER if the kernel
+// or the file system refuses.  Returns -1 on error.
+//
+extern int copyrange(const int in, loff_t from, size_t len, const int out, int &mode);
+//
+// Way to copy into the descriptor out
+//
+extern int copymode(const int out);
+
+class cPassThru {
+private:
+    FILE * fp;
+    int in;
+    int out;
+    int mode;
+    uint_64 size;			// Size of the input file
+    uint_64 from, to;			// Pending run
+public:
+	//
+	// Output goes to the stream file, the input file name is
+	// opened a second time to be independent from the descriptor
+	// used by cHandle, e.g. with O_DIRECT.  Without name or if the
+	// input is not a regular file no run can be copied directly.
+	//
+    cPassThru(FILE *file, const char *name = NULL);
+    virtual ~cPassThru();
+    const bool Direct(void) const { return (in >= 0); };
+	//
+	// The len bytes at the absolute offset of the input are
+	// written unchanged, consecutive runs are merged.
+	//
+    int Pass(const uint_64 offset, const size_t len);
+	//
+	// Write the pending run, has to be done before anything
+	// else is written to the stream file.
+	//
+    int Flush(void);
+};
+
+#endif // __PASSTHRU_H
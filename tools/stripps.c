@@ -35,251 +35,12 @@
 #include <getopt.h>
 #include <signal.h>
 #include <netinet/in.h>
-
-#ifndef AARONS_TYPES
-#define AARONS_TYPES
-typedef unsigned long long uint_64;
-typedef unsigned int   uint_32;
-typedef unsigned short uint_16;
-typedef unsigned char  uint_8;
-
-typedef signed long long sint_64;
-typedef signed int     sint_32;
-typedef signed short   sint_16;
-typedef signed char    sint_8;
-#endif
+#include "handle.h"
+#include "passthru.h"
 
 #define dsyslog(format, args...)	fprintf(stderr, "xlist: " format "\n\r", ## args)
 #define O_PIPE				(O_NONBLOCK|O_ASYNC)
 
-// Exeption class
-class cExeption {
-public:
-    const int reason;
-    cExeption(const int Reason) : reason(Reason) {};
-};
-
-class cHandle {
-private:
-    uint_64 offset;
-    uint_8 *const data;
-    uint_8 * curr;
-    const size_t size;
-    const size_t over;
-    volatile size_t left;
-    volatile size_t head;
-    volatile size_t tail;
-    volatile size_t avail;
-    int fd;
-    cExeption ex;
-    inline bool watch(unsigned long int ms)
-    {
-	fd_set watch;
-	suseconds_t usec = ms*1000;
-	struct timeval tv = { 0, usec};
-
-	FD_ZERO(&watch);
-	FD_SET(fd, &watch);
-
-	int ret = 0;
-	do {
-	    errno = 0;
-	    ret = select(fd+1, &watch, (fd_set*)0, (fd_set*)0, &tv);
-	} while (ret < 0 && errno == EINTR);
-
-	if (tv.tv_usec == usec)
-	    ret = -1;
-	return (ret > 0) ? FD_ISSET(fd, &watch) : false;
-    }
-    void refill(void) throw(cExeption)
-    {
-	size_t free;
-
-	if (fd < 0)		// Static buffer, skip
-	    goto out;
-
-	if (!(free = (size - avail)))
-	    goto out;
-
-	do {
-	    size_t  put = (tail+free > size) ? size - tail : free;
-	    ssize_t real = read(fd, data+tail, put);
-	    if (real < 0) {
-		if (errno == EINTR || errno == EAGAIN)
-		    continue;
-		throw ex;
-	    }
-	    if (real == 0) {
-		if (watch(320))
-		    continue;
-		fd = -1;	// Nothing new, we now have a static buffer
-		break;
-	    }
-	    avail += real;
-	    free  -= real;
-	    tail   = (tail + real) % size;
-
-	} while (free);
-    out:
-	return;
-    };
-    inline void rolling(const size_t pos)
-    {
-	ssize_t roll;
-	//
-	// Case of rolling the memory window over the end of the ring
-	// buffer, just copy the data from the buffer begin to the
-	// overroll area to get one continues memory window.
-	//
-	if ((pos < size) && ((roll = (pos+over) - size) > 0))
-	    memcpy(data+size, data, roll);
-    }
-    inline void movwin(const size_t len)
-    {
-	size_t  want, pos = head;
-
-	if (!len || (over && (len > over)))
-	    goto out;
-
-	if ((fd >= 0) && (avail < size/2))
-	    (void)refill();
-
-	if (avail == 0)
-	    goto out;
-
-	if ((want = len) > avail)
-	    want = avail;
-
-	pos += want;
-	if (over)
-	    rolling(pos);
-
-	head = pos % size;
-	curr = data+head;
-	avail -= want;
-	offset += want;
-    out:
-	return;
-    };
-    inline bool check(const size_t off) throw(cExeption)
-    {
-	if ((fd >= 0) && (avail < size/2))
-	    (void)refill();
-	left = avail;
-	if (over) {
-	    if (left > over)
-		left = over;
-	    rolling(head+off);
-	}
-	if (left < off)
-	    throw ex;
-	return true;
-    }
-public:
-	//
-	// Dynamic buffers filled from file opened with descriptor `file'
-	// or static buffer aready filled.  In case of a dynamic filter
-	// you may provide a minimal memory window step size to be able
-	// to ensure continues buffers from operators even if a buffer
-	// boundary is reached.
-	//
-    cHandle(uint_8 *buf, size_t len, const size_t step = 0, const int file = -1)
-    : data(buf), curr(data), size(len-step), over(step), fd(file), ex(1)
-    {
-	avail = head = tail = 0;
-	offset = 0;
-	if (fd < 0) {		// For static buffers we assume a filled buffer
-	    tail  += size;
-	    avail += size;
-	} else
-	    (void)refill();
-    };
-	//
-	// Return current offset
-	//
-    virtual const uint_64 Offset() const { return offset; };
-	//
-	// Return unsigned character value of
-	// current buffer position
-	//
-    inline operator uint_8  () { return check(1) ? *curr : 0; };
-	//
-	// Return unsigned short value of current
-	// buffer position (in big endian order)
-	//
-    inline operator uint_16 () { return check(2) ? ntohs(*((uint_16*)curr)) : 0; };
-	//
-	// Return unsigned int value of current
-	// buffer position (in big endian order)
-	//
-    inline operator uint_32 () { return check(4) ? ntohl(*((uint_32*)curr)) : 0; };
-	//
-	// Returns true if buffer has at least one
-	// left member
-	//
-    inline operator bool    () { return check(1); };
-	//
-	// A few useful relational operators
-	//
-    inline bool operator >= (const size_t  &o) { return          (avail >= o); };
-    inline bool operator >= (const uint_32 &o) { return          (avail >= (const size_t) o); };
-    inline bool operator >= (const int     &o) { return ((ssize_t)avail >= (const ssize_t)o); };
-    inline bool operator >  (const size_t  &o) { return          (avail >  o); };
-    inline bool operator >  (const uint_32 &o) { return          (avail >  (const size_t) o); };
-    inline bool operator >  (const int     &o) { return ((ssize_t)avail >  (const ssize_t)o); };
-    inline bool operator <= (const size_t  &o) { return          (avail <= o); };
-    inline bool operator <= (const uint_32 &o) { return          (avail <= (const size_t) o); };
-    inline bool operator <= (const int     &o) { return ((ssize_t)avail <= (const ssize_t)o); };
-    inline bool operator <  (const size_t  &o) { return          (avail <  o); };
-    inline bool operator <  (const uint_32 &o) { return          (avail <  (const size_t) o); };
-    inline bool operator <  (const int     &o) { return ((ssize_t)avail <  (const ssize_t)o); };
-    inline bool operator == (const size_t  &o) { return          (avail == o); };
-    inline bool operator == (const uint_32 &o) { return          (avail == (const size_t) o); };
-    inline bool operator == (const int     &o) { return ((ssize_t)avail == (const ssize_t)o); };
-    inline bool operator != (const size_t  &o) { return          (avail != o); };
-    inline bool operator != (const uint_32 &o) { return          (avail != (const size_t) o); };
-    inline bool operator != (const int     &o) { return ((ssize_t)avail != (const ssize_t)o); };
-	//
-	// Skip current read position, goto next (++x).
-	//
-    inline cHandle& operator ++()      { movwin(1); return *this; };
-	//
-	// Skip current read position, goto next.
-	// Return previous (x++).
-	//
-    inline cHandle  operator ++(int)
-    {
-	check(1);		// Before moving position, check and maybe rolling over
-	const cHandle ret(*this); movwin(1); return ret;
-    };
-	//
-	// Skip o positions from current read
-	// position (x += o).
-	//
-    inline cHandle& operator +=(const size_t& o) { movwin(o); return *this; };
-	//
-	// Return current buffer position with at least
-	// o members included. Do not use any position
-	// operator during usage of the pointer to this
-	// buffer position
-	//
-    inline uint_8*  operator ()(const size_t& o) { return check(o) ? curr : NULL; }
-	//
-	// Return left members of buffer. Should be less or
-	// equal to step size if step size is larger than zero.
-	//
-    inline const size_t len(void) { check(0); return left; };
-	//
-	// Exeption handling: you should use this instead
-	// of `while (handle)' or `if (handle)' ... this
-	// avoids checks for potential buffer shortage.
-	//
-#   define foreach(handle)	try { while ((handle))
-#   define test(handle)		try { if((handle))
-#   define end(handle)		} catch (cExeption& ex) { if (ex.reason != 1) throw; }
-
-};
-
 // Signal handling
 static struct sigaction saved_act[SIGUNUSED];
 static void sighandler(int sig)
@@ -328,6 +89,7 @@ static struct option long_option[] =
 {
     {"help",      0, NULL,  'h'},
     {"block",     0, NULL,  'b'},
+    {"direct",    0, NULL,  'D'},
     {"output",    1, NULL,  'o'},
     { NULL,       0, NULL,   0 },
 };
@@ -338,23 +100,29 @@ static void help(void)
         printf("\nAvailable options:\n");
         printf("  -h, --help         this help\n");
         printf("  -b, --block        use blocking read mode on stdin\n");
+        printf("  -D, --direct       read files with O_DIRECT bypassing the page cache\n");
         printf("  -o, --output=file  use this file for output\n");
 }
 
 static void scan(cHandle handle);
+static cPassThru *pass = NULL;
 
 int main(int argc, char *argv[])
 {
     bool block = false;
+    int mode = HANDLE_ASYNC;
     cHandle *handle;
     char *output;
     int c;
 
-    while ((c = getopt_long(argc, argv, "bo:hadpt:", long_option, NULL)) > 0) {
+    while ((c = getopt_long(argc, argv, "bDo:hadpt:", long_option, NULL)) > 0) {
 	switch (c) {
 	case 'b':
 	    block = true;
 	    break;
+	case 'D':
+	    mode |= HANDLE_DIRECT;
+	    break;
 	case 'o':
 	    if (!optarg || *optarg == '-') {
 		help();
@@ -395,7 +163,7 @@ int main(int argc, char *argv[])
 
 #   define STEPSIZE	 4096
 #   define OVERALL	(128*STEPSIZE)
-    static uint_8* buf = (uint_8*)malloc(OVERALL);
+    static uint_8* buf = (uint_8*)valloc(OVERALL);	// Page aligned for O_DIRECT
 
     if (!buf)
 	exit(1);
@@ -403,6 +171,7 @@ int main(int argc, char *argv[])
     bool loop = true;
     while (true) {
 	int fd = STDIN_FILENO;
+	const char *name = NULL;
 
 	if (argc <= 0) {
 	    if (!loop)
@@ -422,15 +191,20 @@ int main(int argc, char *argv[])
 		dsyslog("Couldn't open file %s: %s", *argv, strerror(errno));
 		exit(1);
 	    }
+	    name = *argv;
 	    argv++;
 	    argc--;
 	}
 	loop = false;
 
-	handle = new cHandle(&buf[0], OVERALL, STEPSIZE, fd);
+	handle = new cHandle(&buf[0], OVERALL, STEPSIZE, fd, mode);
+	pass = new cPassThru(out, name);	// Unchanged packets are copied by the kernel
 
 	scan(*handle);
 
+	delete pass;
+	pass = NULL;
+
 	if (handle) {
 	    delete handle;
 	    handle = NULL;
@@ -453,6 +227,7 @@ static void scan(cHandle handle)
 	uint_32 ul = handle;
 	uint_32 lu = htonl(ul);
 	if ((ul & 0xffffff00) == 0x0000100) {
+	    const uint_64 offset = handle.Offset();
 	    handle += 4;
 
 	    uint_8  ub = (uint_8)(ul & 0x000000ff);
@@ -490,6 +265,11 @@ static void scan(cHandle handle)
 		break;
 	    case 0xc0 ... 0xdf:	// MPEG-1 or MPEG-2 audio stream
 		handle += 2;
+		if (pass->Direct()) {
+		    pass->Pass(offset, 6+m);
+		    handle.skip(m);
+		    break;
+		}
 		fwrite((uint_8*)&lu, 1, 4, out);
 		fwrite((uint_8*)&M, 1, 2, out);
 		if (m > handle.len())
@@ -500,6 +280,11 @@ static void scan(cHandle handle)
 		break;
 	    case 0xe0 ... 0xef:	// MPEG-1 or MPEG-2 video stream
 		handle += 2;
+		if (pass->Direct()) {
+		    pass->Pass(offset, 6+m);
+		    handle.skip(m);
+		    break;
+		}
 		fwrite((uint_8*)&lu, 1, 4, out);
 		fwrite((uint_8*)&M, 1, 2, out);
 		if (m > handle.len())
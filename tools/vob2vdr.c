@@ -35,251 +35,12 @@
 #include <getopt.h>
 #include <signal.h>
 #include <netinet/in.h>
-
-#ifndef AARONS_TYPES
-#define AARONS_TYPES
-typedef unsigned long long uint_64;
-typedef unsigned int   uint_32;
-typedef unsigned short uint_16;
-typedef unsigned char  uint_8;
-
-typedef signed long long sint_64;
-typedef signed int     sint_32;
-typedef signed short   sint_16;
-typedef signed char    sint_8;
-#endif
+#include "handle.h"
+#include "passthru.h"
 
 #define dsyslog(format, args...)	fprintf(stderr, "xlist: " format "\n\r", ## args)
 #define O_PIPE				(O_NONBLOCK|O_ASYNC)
 
-// Exeption class
-class cExeption {
-public:
-    const int reason;
-    cExeption(const int Reason) : reason(Reason) {};
-};
-
-class cHandle {
-private:
-    uint_64 offset;
-    uint_8 *const data;
-    uint_8 * curr;
-    const size_t size;
-    const size_t over;
-    volatile size_t left;
-    volatile size_t head;
-    volatile size_t tail;
-    volatile size_t avail;
-    int fd;
-    cExeption ex;
-    inline bool watch(unsigned long int ms)
-    {
-	fd_set watch;
-	suseconds_t usec = ms*1000;
-	struct timeval tv = { 0, usec};
-
-	FD_ZERO(&watch);
-	FD_SET(fd, &watch);
-
-	int ret = 0;
-	do {
-	    errno = 0;
-	    ret = select(fd+1, &watch, (fd_set*)0, (fd_set*)0, &tv);
-	} while (ret < 0 && errno == EINTR);
-
-	if (tv.tv_usec == usec)
-	    ret = -1;
-	return (ret > 0) ? FD_ISSET(fd, &watch) : false;
-    }
-    void refill(void) throw(cExeption)
-    {
-	size_t free;
-
-	if (fd < 0)		// Static buffer, skip
-	    goto out;
-
-	if (!(free = (size - avail)))
-	    goto out;
-
-	do {
-	    size_t  put = (tail+free > size) ? size - tail : free;
-	    ssize_t real = read(fd, data+tail, put);
-	    if (real < 0) {
-		if (errno == EINTR || errno == EAGAIN)
-		    continue;
-		throw ex;
-	    }
-	    if (real == 0) {
-		if (watch(320))
-		    continue;
-		fd = -1;	// Nothing new, we now have a static buffer
-		break;
-	    }
-	    avail += real;
-	    free  -= real;
-	    tail   = (tail + real) % size;
-
-	} while (free);
-    out:
-	return;
-    };
-    inline void rolling(const size_t pos)
-    {
-	ssize_t roll;
-	//
-	// Case of rolling the memory window over the end of the ring
-	// buffer, just copy the data from the buffer begin to the
-	// overroll area to get one continues memory window.
-	//
-	if ((pos < size) && ((roll = (pos+over) - size) > 0))
-	    memcpy(data+size, data, roll);
-    }
-    inline void movwin(const size_t len)
-    {
-	size_t  want, pos = head;
-
-	if (!len || (over && (len > over)))
-	    goto out;
-
-	if ((fd >= 0) && (avail < size/2))
-	    (void)refill();
-
-	if (avail == 0)
-	    goto out;
-
-	if ((want = len) > avail)
-	    want = avail;
-
-	pos += want;
-	if (over)
-	    rolling(pos);
-
-	head = pos % size;
-	curr = data+head;
-	avail -= want;
-	offset += want;
-    out:
-	return;
-    };
-    inline bool check(const size_t off) throw(cExeption)
-    {
-	if ((fd >= 0) && (avail < size/2))
-	    (void)refill();
-	left = avail;
-	if (over) {
-	    if (left > over)
-		left = over;
-	    rolling(head+off);
-	}
-	if (left < off)
-	    throw ex;
-	return true;
-    }
-public:
-	//
-	// Dynamic buffers filled from file opened with descriptor `file'
-	// or static buffer aready filled.  In case of a dynamic filter
-	// you may provide a minimal memory window step size to be able
-	// to ensure continues buffers from operators even if a buffer
-	// boundary is reached.
-	//
-    cHandle(uint_8 *buf, size_t len, const size_t step = 0, const int file = -1)
-    : data(buf), curr(data), size(len-step), over(step), fd(file), ex(1)
-    {
-	avail = head = tail = 0;
-	offset = 0;
-	if (fd < 0) {		// For static buffers we assume a filled buffer
-	    tail  += size;
-	    avail += size;
-	} else
-	    (void)refill();
-    };
-	//
-	// Return current offset
-	//
-    virtual const uint_64 Offset() const { return offset; };
-	//
-	// Return unsigned character value of
-	// current buffer position
-	//
-    inline operator uint_8  () { return check(1) ? *curr : 0; };
-	//
-	// Return unsigned short value of current
-	// buffer position (in big endian order)
-	//
-    inline operator uint_16 () { return check(2) ? ntohs(*((uint_16*)curr)) : 0; };
-	//
-	// Return unsigned int value of current
-	// buffer position (in big endian order)
-	//
-    inline operator uint_32 () { return check(4) ? ntohl(*((uint_32*)curr)) : 0; };
-	//
-	// Returns true if buffer has at least one
-	// left member
-	//
-    inline operator bool    () { return check(1); };
-	//
-	// A few useful relational operators
-	//
-    inline bool operator >= (const size_t  &o) { return          (avail >= o); };
-    inline bool operator >= (const uint_32 &o) { return          (avail >= (const size_t) o); };
-    inline bool operator >= (const int     &o) { return ((ssize_t)avail >= (const ssize_t)o); };
-    inline bool operator >  (const size_t  &o) { return          (avail >  o); };
-    inline bool operator >  (const uint_32 &o) { return          (avail >  (const size_t) o); };
-    inline bool operator >  (const int     &o) { return ((ssize_t)avail >  (const ssize_t)o); };
-    inline bool operator <= (const size_t  &o) { return          (avail <= o); };
-    inline bool operator <= (const uint_32 &o) { return          (avail <= (const size_t) o); };
-    inline bool operator <= (const int     &o) { return ((ssize_t)avail <= (const ssize_t)o); };
-    inline bool operator <  (const size_t  &o) { return          (avail <  o); };
-    inline bool operator <  (const uint_32 &o) { return          (avail <  (const size_t) o); };
-    inline bool operator <  (const int     &o) { return ((ssize_t)avail <  (const ssize_t)o); };
-    inline bool operator == (const size_t  &o) { return          (avail == o); };
-    inline bool operator == (const uint_32 &o) { return          (avail == (const size_t) o); };
-    inline bool operator == (const int     &o) { return ((ssize_t)avail == (const ssize_t)o); };
-    inline bool operator != (const size_t  &o) { return          (avail != o); };
-    inline bool operator != (const uint_32 &o) { return          (avail != (const size_t) o); };
-    inline bool operator != (const int     &o) { return ((ssize_t)avail != (const ssize_t)o); };
-	//
-	// Skip current read position, goto next (++x).
-	//
-    inline cHandle& operator ++()      { movwin(1); return *this; };
-	//
-	// Skip current read position, goto next.
-	// Return previous (x++).
-	//
-    inline cHandle  operator ++(int)
-    {
-	check(1);		// Before moving position, check and maybe rolling over
-	const cHandle ret(*this); movwin(1); return ret;
-    };
-	//
-	// Skip o positions from current read
-	// position (x += o).
-	//
-    inline cHandle& operator +=(const size_t& o) { movwin(o); return *this; };
-	//
-	// Return current buffer position with at least
-	// o members included. Do not use any position
-	// operator during usage of the pointer to this
-	// buffer position
-	//
-    inline uint_8*  operator ()(const size_t& o) { return check(o) ? curr : NULL; }
-	//
-	// Return left members of buffer. Should be less or
-	// equal to step size if step size is larger than zero.
-	//
-    inline const size_t len(void) { check(0); return left; };
-	//
-	// Exeption handling: you should use this instead
-	// of `while (handle)' or `if (handle)' ... this
-	// avoids checks for potential buffer shortage.
-	//
-#   define foreach(handle)	try { while ((handle))
-#   define test(handle)		try { if((handle))
-#   define end(handle)		} catch (cExeption& ex) { if (ex.reason != 1) throw; }
-
-};
-
 // Signal handling
 static struct sigaction saved_act[SIGUNUSED];
 static void sighandler(int sig)
@@ -328,11 +89,13 @@ static struct option long_option[] =
 {
     {"help",      0, NULL,  'h'},
     {"block",     0, NULL,  'b'},
+    {"direct",    0, NULL,  'D'},
     {"output",    1, NULL,  'o'},
     {"ac3",       1, NULL,  'a'},
     {"dts",       1, NULL,  'd'},
     {"pcm",       1, NULL,  'p'},
     {"track",     1, NULL,  't'},
+    {"extract",   1, NULL,  'x'},
     { NULL,       0, NULL,   0 },
 };
 
@@ -342,11 +105,18 @@ static void help(void)
         printf("\nAvailable options:\n");
         printf("  -h, --help         this help\n");
         printf("  -b, --block        use blocking read mode on stdin\n");
+        printf("  -D, --direct       read files with O_DIRECT bypassing the page cache\n");
         printf("  -o, --output=file  use this file for output\n");
         printf("  -a, --ac3          include AC3 audio stream\n");
         printf("  -d, --dts          include DTS audio stream\n");
         printf("  -p, --pcm          include linear PCM audio stream\n");
         printf("  -t, --track=[1..8] set track number for audio stream\n");
+        printf("  -x, --extract=ac3|dts|pcm:[1..8][=file]\n");
+        printf("                     include this audio stream, may be given several\n");
+        printf("                     times to extract all in one pass.  With a file\n");
+        printf("                     the stream goes together with video and MPEG\n");
+        printf("                     audio into its own file, otherwise into the\n");
+        printf("                     output with the sub streams renumbered\n");
 }
 
 // Forward declaration
@@ -365,20 +135,44 @@ static void help(void)
 
 static uint_16 flags = (AC3|TR0);
 
+//
+// Audio streams selected with -x, output 0 is the common output
+//
+#define TRACKS	24
+#define SINKS	(TRACKS+1)
+
+static struct {
+    uint_8 sub;			// Sub stream id of the track
+    uint_8 renum;		// Sub stream id written
+    int out;			// Index of the output
+} track[TRACKS];
+static int tracks = 0;
+
+static struct {
+    FILE *fp;
+    cPassThru *pass;
+} sink[SINKS];
+static int sinks = 1;
+
+static bool extract(const char *arg);
 static void scan(cHandle handle);
 
 int main(int argc, char *argv[])
 {
     bool block = false;
+    int mode = HANDLE_ASYNC;
     cHandle *handle;
     char *output;
     int c, tr;
 
-    while ((c = getopt_long(argc, argv, "bo:hadpt:", long_option, NULL)) > 0) {
+    while ((c = getopt_long(argc, argv, "bDo:hadpt:x:", long_option, NULL)) > 0) {
 	switch (c) {
 	case 'b':
 	    block = true;
 	    break;
+	case 'D':
+	    mode |= HANDLE_DIRECT;
+	    break;
 	case 'o':
 	    if (!optarg || *optarg == '-') {
 		help();
@@ -406,6 +200,12 @@ int main(int argc, char *argv[])
 	case 'p':
 	    flags = PCM | (flags & 0x38);
 	    break;
+	case 'x':
+	    if (!optarg || !extract(optarg)) {
+		help();
+		exit(1);
+	    }
+	    break;
 	case 't':
 	    if (!optarg || *optarg == '-') {
 		help();
@@ -428,6 +228,13 @@ int main(int argc, char *argv[])
 	    break;
 	}
     }
+    sink[0].fp = out;
+    for (int i = 0, n[3] = {0, 0, 0}; i < tracks; i++) {
+	if (track[i].out)
+	    continue;		// Own output keeps the sub stream id
+	const int k = (track[i].sub >= 0xa0) ? 2 : ((track[i].sub >= 0x88) ? 1 : 0);
+	track[i].renum = (track[i].sub & 0xf8) + n[k]++;
+    }
     argv += optind;
     argc -= optind;
     if (*argv && **argv == '-') {
@@ -444,7 +251,7 @@ int main(int argc, char *argv[])
 
 #   define STEPSIZE	 4096
 #   define OVERALL	(128*STEPSIZE)
-    static uint_8* buf = (uint_8*)malloc(OVERALL);
+    static uint_8* buf = (uint_8*)valloc(OVERALL);	// Page aligned for O_DIRECT
 
     if (!buf)
 	exit(1);
@@ -452,6 +259,7 @@ int main(int argc, char *argv[])
     bool loop = true;
     while (true) {
 	int fd = STDIN_FILENO;
+	const char *name = NULL;
 
 	if (argc <= 0) {
 	    if (!loop)
@@ -471,15 +279,23 @@ int main(int argc, char *argv[])
 		dsyslog("Couldn't open file %s: %s", *argv, strerror(errno));
 		exit(1);
 	    }
+	    name = *argv;
 	    argv++;
 	    argc--;
 	}
 	loop = false;
 
-	handle = new cHandle(&buf[0], OVERALL, STEPSIZE, fd);
+	handle = new cHandle(&buf[0], OVERALL, STEPSIZE, fd, mode);
+	for (int o = 0; o < sinks; o++)	// Unchanged packets are copied by the kernel
+	    sink[o].pass = new cPassThru(sink[o].fp, name);
 
 	scan(*handle);
 
+	for (int o = 0; o < sinks; o++) {
+	    delete sink[o].pass;
+	    sink[o].pass = NULL;
+	}
+
 	if (handle) {
 	    delete handle;
 	    handle = NULL;
@@ -493,8 +309,87 @@ int main(int argc, char *argv[])
     return 0;
 }
 
+static bool extract(const char *arg)
+{
+    const char *file;
+    int i, tr, o = 0;
+    uint_8 base;
+
+    if (tracks >= TRACKS)
+	goto err;
+    if (!strncasecmp(arg, "ac3:", 4))
+	base = 0x80;
+    else if (!strncasecmp(arg, "dts:", 4))
+	base = 0x88;
+    else if (!strncasecmp(arg, "pcm:", 4))
+	base = 0xa0;
+    else
+	goto err;
+    if ((tr = atoi(arg+4)) < 1 || tr > 8)
+	goto err;
+
+    if ((file = strchr(arg, '=')) && *(++file)) {
+	o = sinks;
+	if (!(sink[o].fp = fopen(file, "a+"))) {
+	    dsyslog("fopen(%s) failed: %s", file, strerror(errno));
+	    goto err;
+	}
+	sinks++;
+    }
+
+    for (i = 0; i < tracks; i++) {
+	if (track[i].sub == base + tr - 1 && track[i].out == o)
+	    return true;		// Given twice
+    }
+    track[tracks].sub   = base + tr - 1;
+    track[tracks].renum = base + tr - 1;
+    track[tracks].out   = o;
+    tracks++;
+    return true;
+err:
+    return false;
+}
+
+//
+// Write the packet at the absolute offset with the length n of its
+// contents, m of them are visible in the memory window at data, to
+// the output o.  If h is not negative the sub stream id at data[h]
+// is replaced by id, all other packets are copied unchanged.
+//
+static void emit(const int o, const uint_64 offset, const uint_32 lu, const uint_16 M,
+		 const uint_8 *data, const uint_16 m, const uint_16 n,
+		 const int h = -1, const uint_8 id = 0)
+{
+    cPassThru *const pass = sink[o].pass;
+    FILE *const fp = sink[o].fp;
+    const bool same = (h < 0 || data[h] == id);
+
+    if (pass->Direct()) {
+	if (same) {
+	    pass->Pass(offset, 6+n);
+	    return;
+	}
+	pass->Flush();
+    }
+    fwrite((uint_8*)&lu, 1, 4, fp);
+    fwrite((uint_8*)&M, 1, 2, fp);
+    if (!data)
+	return;
+    if (same) {
+	fwrite(data, sizeof(uint_8), m, fp);
+	return;
+    }
+    fwrite(data, sizeof(uint_8), h, fp);
+    fputc(id, fp);
+    if (pass->Direct())
+	pass->Pass(offset+6+h+1, n-h-1);
+    else
+	fwrite(data+h+1, sizeof(uint_8), m-h-1, fp);
+}
+
 static void scan(cHandle handle)
 {
+    const bool direct = sink[0].pass->Direct();
     char I_Frame = 0; 
     bool Header  = false;
 
@@ -502,12 +397,14 @@ static void scan(cHandle handle)
 	uint_32 ul = handle;
 	uint_32 lu = htonl(ul);
 	if ((ul & 0xffffff00) == 0x0000100) {
+	    const uint_64 offset = handle.Offset();
 	    handle += 4;
 
 	    uint_8  ub = (uint_8)(ul & 0x000000ff);
 	    uint_16 m  = handle;
 	    uint_16 M  = htons(m);
 	    uint_8  l  = (uint_8)((m>>8)&0x00ff);
+	    const uint_16 n = m;		// Length before clipping to the window
 
 	    switch (ub) {
 	    case 0xb9:		// Program end (terminates a program stream)
@@ -535,37 +432,51 @@ static void scan(cHandle handle)
 			break;
 		    if (m < (h = p[2] + 3))
 			break;
-		    switch (p[h]) {
-		    case 0x80 ... 0x87:		// Dolby Digital Audio
-			if ((flags & 3) != AC3)
-			    goto skip;
-			if (!(flags & 4))
-			    flags = (flags & 3)|4|((p[h] & 7)<<3);
-			if ((p[h] & 7) != (flags >> 3))
-			    goto skip;
-			break;
-		    case 0x88 ... 0x8f:		// DTS Audio
-			if ((flags & 3) != DTS)
-			    goto skip;
-			if (!(flags & 4))
-			    flags = (flags & 3)|4|((p[h] & 7)<<3);
-			if ((p[h] & 7) != (flags >> 3))
-			    goto skip;
-			break;
-		    case 0xa0 ... 0xa7:		// Linear PCM Audio
-			if ((flags & 3) != PCM)
+		    if (tracks) {
+			bool any = false;
+			for (int i = 0; i < tracks; i++) {
+			    if (track[i].sub != p[h])
+				continue;
+			    emit(track[i].out, offset, lu, M, p, m, n, h, track[i].renum);
+			    any = true;
+			}
+			if (!any)
 			    goto skip;
-			if (!(flags & 4))
-			    flags = (flags & 3)|4|((p[h] & 7)<<3);
-			if ((p[h] & 7) != (flags >> 3))
+		    } else {
+			switch (p[h]) {
+			case 0x80 ... 0x87:		// Dolby Digital Audio
+			    if ((flags & 3) != AC3)
+				goto skip;
+			    if (!(flags & 4))
+				flags = (flags & 3)|4|((p[h] & 7)<<3);
+			    if ((p[h] & 7) != (flags >> 3))
+				goto skip;
+			    break;
+			case 0x88 ... 0x8f:		// DTS Audio
+			    if ((flags & 3) != DTS)
+				goto skip;
+			    if (!(flags & 4))
+				flags = (flags & 3)|4|((p[h] & 7)<<3);
+			    if ((p[h] & 7) != (flags >> 3))
+				goto skip;
+			    break;
+			case 0xa0 ... 0xa7:		// Linear PCM Audio
+			    if ((flags & 3) != PCM)
+				goto skip;
+			    if (!(flags & 4))
+				flags = (flags & 3)|4|((p[h] & 7)<<3);
+			    if ((p[h] & 7) != (flags >> 3))
+				goto skip;
+			    break;
+			default:
 			    goto skip;
+			}
+			emit(0, offset, lu, M, p, m, n);
+		    }
+		    if (direct) {
+			handle.skip(n);
 			break;
-		    default:
-			goto skip;
 		    }
-		    fwrite((uint_8*)&lu, 1, 4, out);
-		    fwrite((uint_8*)&M, 1, 2, out);
-		    fwrite(p, sizeof(uint_8), m, out);
 		}
 	    skip:
 		handle += m;
@@ -582,22 +493,30 @@ static void scan(cHandle handle)
 		break;
 	    case 0xc0 ... 0xdf:	// MPEG-1 or MPEG-2 audio stream
 		handle += 2;
-		fwrite((uint_8*)&lu, 1, 4, out);
-		fwrite((uint_8*)&M, 1, 2, out);
+		if (direct) {
+		    for (int o = 0; o < sinks; o++)
+			emit(o, offset, lu, M, NULL, 0, n);
+		    handle.skip(n);
+		    break;
+		}
 		if (m > handle.len())
 		    m = handle.len();
-		if (handle >= (size_t)m)
-		    fwrite((uint_8*)handle(m), sizeof(uint_8), m, out);
+		for (int o = 0; o < sinks; o++)
+		    emit(o, offset, lu, M, (handle >= (size_t)m) ? handle(m) : NULL, m, n);
 		handle += m;
 		break;
 	    case 0xe0 ... 0xef:	// MPEG-1 or MPEG-2 video stream
 		handle += 2;
-		fwrite((uint_8*)&lu, 1, 4, out);
-		fwrite((uint_8*)&M, 1, 2, out);
+		if (direct) {
+		    for (int o = 0; o < sinks; o++)
+			emit(o, offset, lu, M, NULL, 0, n);
+		    handle.skip(n);
+		    break;
+		}
 		if (m > handle.len())
 		    m = handle.len();
-		if (handle >= (size_t)m)
-		    fwrite((uint_8*)handle(m), sizeof(uint_8), m, out);
+		for (int o = 0; o < sinks; o++)
+		    emit(o, offset, lu, M, (handle >= (size_t)m) ? handle(m) : NULL, m, n);
 		handle += m;
 		break;
 	    case 0xf0:		// ECM Stream
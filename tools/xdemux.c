@@ -0,0 +1,538 @@
+/*
+ * xdemux.c:	Demultiplex a PES stream once for listing, stripping,
+ *		cutting, indexing, and audio statistics at the same time
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ * Copyright (C) 2003-2005 Werner Fink, <werner@suse.de>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include "demux.h"
+
+#define dsyslog(format, args...)	fprintf(stderr, "xdemux: " format "\n\r", ## args)
+#define O_PIPE				(O_NONBLOCK|O_ASYNC)
+
+#define PTS_MASK	((1ULL<<33)-1)		// Time stamps wrap around after 33 bits
+#define PTS_SECOND	90000ULL
+
+// Signal handling
+static struct sigaction saved_act[SIGUNUSED];
+static void sighandler(int sig)
+{
+    sigset_t set;
+
+    if (sig != SIGPIPE && sig != SIGIO)
+	dsyslog("Catch %s", strsignal(sig));
+
+    if (sig == SIGIO)
+	return;
+
+    usleep(100);
+
+    if (sigaction (sig, &saved_act[sig], NULL))
+	_exit(1);
+    if (sigemptyset(&set) || sigaddset(&set, sig) ||
+	sigprocmask(SIG_UNBLOCK, &set, NULL))
+	_exit(1);
+    kill(-getpid(), sig);	// Raise signal
+}
+
+static void install_sighandler(int sig)
+{
+    struct sigaction act;
+    if (sigaction (sig, NULL, &saved_act[sig]))		// Old action handler
+	return;
+    if (saved_act[sig].sa_handler == sighandler)	// Compare with our
+	return;
+
+    act.sa_handler = sighandler;
+    if (sig == SIGIO) {
+	act.sa_flags = SA_RESTART;
+    } else {
+	act.sa_flags = SA_ONESHOT;
+    }
+    if (sigemptyset (&act.sa_mask) < 0)
+	_exit(1);
+    if (sigaction (sig, &act, NULL))
+	_exit(1);
+}
+
+static FILE* out = stdout;
+
+static FILE* create(const char *name)
+{
+    FILE *fp;
+    if (!name || *name == '-')
+	return NULL;
+    if (!(fp = fopen(name, "w")))
+	dsyslog("fopen(%s) failed: %s", name, strerror(errno));
+    return fp;
+}
+
+//
+// Search a start code with the given stream id, or any of the
+// ids given by a mask bit (picture 0x1, sequence 0x2, group of
+// pictures 0x4), within the payload of a packet.
+//
+static const uint_8 *search(const uint_8 *const b, const uint_8 *const e, const uint_32 mask)
+{
+    const uint_8 *p = b + 2;
+
+    while (p + 1 < e && (p = (const uint_8 *)memchr(p, 0x01, e - p - 1))) {
+	if (!p[-1] && !p[-2]) {
+	    const uint_8 id = p[1];
+	    if ((id == 0x00 && (mask & 0x1)) || (id == 0xb3 && (mask & 0x2)) ||
+		(id == 0xb8 && (mask & 0x4)))
+		return p + 1;			// Points to the id
+	}
+	p++;
+    }
+    return NULL;
+}
+
+//
+// Listing of all packets, one line per packet
+//
+class cList : public cConsumer {
+private:
+    FILE *fp;
+public:
+    cList(FILE *file) : fp(file) {};
+    virtual void Packet(const pes_t &pes)
+    {
+	fprintf(fp, "%12llu %02x", pes.offset, pes.stream);
+	if (pes.stream == 0xbd)
+	    fprintf(fp, ".%02x", pes.sub);
+	else
+	    fprintf(fp, "   ");
+	fprintf(fp, " %5u", pes.len);
+	if (pes.pts != DEMUX_NOTS)
+	    fprintf(fp, " %s %10llu", (pes.stream == 0xba) ? "SCR" : "PTS", pes.pts);
+	if (pes.dts != DEMUX_NOTS)
+	    fprintf(fp, " DTS %10llu", pes.dts);
+	if (pes.flags & DEMUX_F_MPEG1)
+	    fprintf(fp, " MPEG1");
+	fputc('\n', fp);
+    };
+};
+
+//
+// Remove any private stream and all packs, only the audio and
+// video packets are written as done by stripps
+//
+class cStrip : public cConsumer {
+private:
+    FILE *fp;
+public:
+    cStrip(FILE *file) : fp(file) {};
+    virtual void Packet(const pes_t &pes)
+    {
+	if (pes.stream < 0xc0 || pes.stream > 0xef)
+	    return;
+	if (fwrite(pes.data, 1, pes.len, fp) != pes.len)
+	    dsyslog("fwrite() failed: %s", strerror(errno));
+    };
+    virtual void Done(void) { fflush(fp); };
+};
+
+//
+// Write the index.vdr entries as done by genindex
+//
+class cIndex : public cConsumer {
+private:
+    struct tIndex {int offset; unsigned char type; unsigned char number; short reserved; };
+    FILE *fp;
+    int number;
+public:
+    cIndex(FILE *file) : fp(file), number(0) {};
+    virtual void Begin(const int num) { number = num; };
+    virtual void Packet(const pes_t &pes)
+    {
+	const uint_8 *const e = pes.payload + pes.size;
+	const uint_8 *p = pes.payload;
+
+	if (pes.stream < 0xe0 || pes.stream > 0xef)
+	    return;
+	while ((p = search(p, e, 0x1))) {
+	    const uint_8 type = (p + 2 < e) ? ((p[2]>>3) & 0x07) : 0;
+	    if (type >= 1 && type <= 3) {
+		const struct tIndex i = {(int)pes.offset, type, (unsigned char)number, 0};
+		if (fwrite(&i, 1, sizeof(struct tIndex), fp) != sizeof(struct tIndex))
+		    dsyslog("fwrite() failed: %s", strerror(errno));
+		break;
+	    }
+	}
+    };
+    virtual void Done(void) { fflush(fp); };
+};
+
+//
+// Keep the parts of the stream within the marks, the time is the
+// presentation time of the video relative to the first video
+// packet.  The state is switched only at a sequence header, a
+// group of pictures, or an I frame to start with a decodable picture.
+//
+#define CUT_MARKS	32
+
+class cCut : public cConsumer {
+private:
+    FILE *fp;
+    struct {
+	uint_64 from, to;
+    } mark[CUT_MARKS];
+    int marks;
+    uint_64 first;
+    uint_64 now;
+    bool inside;
+    bool within(const uint_64 t) const
+    {
+	for (int i = 0; i < marks; i++)
+	    if (t >= mark[i].from && t < mark[i].to)
+		return true;
+	return false;
+    };
+    bool entry(const pes_t &pes) const
+    {
+	const uint_8 *const e = pes.payload + pes.size;
+	const uint_8 *p = pes.payload;
+	while ((p = search(p, e, 0x7))) {
+	    if (*p != 0x00)
+		return true;		// Sequence header or group of pictures
+	    if (p + 2 < e && ((p[2]>>3) & 0x07) == 1)
+		return true;		// I frame
+	}
+	return false;
+    };
+public:
+    cCut(FILE *file) : fp(file), marks(0), first(DEMUX_NOTS), now(0), inside(false) {};
+	//
+	// Marks are h:mm:ss[.ff]-h:mm:ss[.ff] separated by commas,
+	// an open end is allowed for the last one.
+	//
+    bool Marks(const char *list)
+    {
+	const char *p = list;
+	while (p && *p) {
+	    unsigned int h[2] = {0, 0}, m[2] = {0, 0}, s[2] = {0, 0}, f[2] = {0, 0};
+	    int n;
+	    if (marks >= CUT_MARKS)
+		goto err;
+	    if (sscanf(p, "%u:%u:%u%n", &h[0], &m[0], &s[0], &n) != 3)
+		goto err;
+	    p += n;
+	    if (*p == '.' && sscanf(p, ".%u%n", &f[0], &n) == 1)
+		p += n;
+	    mark[marks].from = ((h[0]*60 + m[0])*60 + s[0])*PTS_SECOND + f[0]*PTS_SECOND/25;
+	    mark[marks].to   = ~0ULL;
+	    if (*p == '-') {
+		p++;
+		if (*p && *p != ',') {
+		    if (sscanf(p, "%u:%u:%u%n", &h[1], &m[1], &s[1], &n) != 3)
+			goto err;
+		    p += n;
+		    if (*p == '.' && sscanf(p, ".%u%n", &f[1], &n) == 1)
+			p += n;
+		    mark[marks].to = ((h[1]*60 + m[1])*60 + s[1])*PTS_SECOND + f[1]*PTS_SECOND/25;
+		}
+	    }
+	    marks++;
+	    if (*p == ',')
+		p++;
+	    else if (*p)
+		goto err;
+	}
+	return (marks > 0);
+    err:
+	dsyslog("Wrong marks %s", list);
+	return false;
+    };
+    virtual void Packet(const pes_t &pes)
+    {
+	if (pes.stream >= 0xe0 && pes.stream <= 0xef) {
+	    if (pes.pts != DEMUX_NOTS) {
+		if (first == DEMUX_NOTS)
+		    first = pes.pts;
+		now = (pes.pts - first) & PTS_MASK;
+	    }
+	    if (entry(pes))
+		inside = within(now);
+	}
+	if (!inside)
+	    return;
+	if (fwrite(pes.data, 1, pes.len, fp) != pes.len)
+	    dsyslog("fwrite() failed: %s", strerror(errno));
+    };
+    virtual void Done(void) { fflush(fp); };
+};
+
+//
+// Number of frames, bytes, and time stamp gaps of all audio streams
+//
+#define AUDIO_STREAMS	64
+
+class cAudio : public cConsumer {
+private:
+    FILE *fp;
+    struct {
+	uint_64 packets;
+	uint_64 bytes;
+	uint_64 first;
+	uint_64 last;
+	uint_32 gaps;
+	uint_32 backward;
+	uint_16 id;
+    } stat[AUDIO_STREAMS];
+    int streams;
+public:
+    cAudio(FILE *file) : fp(file), streams(0) {};
+    virtual void Packet(const pes_t &pes)
+    {
+	uint_16 id;
+	int i;
+
+	switch (pes.stream) {
+	case 0xbd:
+	    if (pes.sub >= 0x20 && pes.sub <= 0x3f)
+		return;			// Sub pictures
+	    id = 0x100 | pes.sub;
+	    break;
+	case 0xc0 ... 0xdf:
+	    id = pes.stream;
+	    break;
+	default:
+	    return;
+	}
+
+	for (i = 0; i < streams; i++)
+	    if (stat[i].id == id)
+		break;
+	if (i >= streams) {
+	    if (streams >= AUDIO_STREAMS)
+		return;
+	    memset(&stat[i], 0, sizeof(stat[i]));
+	    stat[i].id = id;
+	    stat[i].first = stat[i].last = DEMUX_NOTS;
+	    streams++;
+	}
+	stat[i].packets++;
+	stat[i].bytes += pes.size;
+	if (pes.pts == DEMUX_NOTS)
+	    return;
+	if (stat[i].first == DEMUX_NOTS)
+	    stat[i].first = pes.pts;
+	else {
+	    const uint_64 delta = (pes.pts - stat[i].last) & PTS_MASK;
+	    if (delta > PTS_MASK/2)
+		stat[i].backward++;
+	    else if (delta > PTS_SECOND)
+		stat[i].gaps++;
+	}
+	stat[i].last = pes.pts;
+    };
+    virtual void Done(void)
+    {
+	for (int i = 0; i < streams; i++) {
+	    uint_64 ms = 0;
+	    if (stat[i].first != DEMUX_NOTS)
+		ms = ((stat[i].last - stat[i].first) & PTS_MASK) / 90;
+	    if (stat[i].id & 0x100)
+		fprintf(fp, "audio bd.%02x:", stat[i].id & 0xff);
+	    else
+		fprintf(fp, "audio %02x   :", stat[i].id);
+	    fprintf(fp, " %llu packets, %llu bytes, %llu.%03llu s, %u gaps, %u backward\n",
+		    stat[i].packets, stat[i].bytes, ms/1000, ms%1000, stat[i].gaps, stat[i].backward);
+	}
+	fflush(fp);
+    };
+};
+
+// Known options
+static struct option long_option[] =
+{
+    {"help",      0, NULL,  'h'},
+    {"block",     0, NULL,  'b'},
+    {"direct",    0, NULL,  'D'},
+    {"output",    1, NULL,  'o'},
+    {"list",      0, NULL,  'l'},
+    {"strip",     1, NULL,  's'},
+    {"cut",       1, NULL,  'c'},
+    {"marks",     1, NULL,  'm'},
+    {"index",     1, NULL,  'i'},
+    {"audio",     0, NULL,  'a'},
+    { NULL,       0, NULL,   0 },
+};
+
+static void help(void)
+{
+        printf("Usage: xdemux <options> [file ...]\n");
+        printf("\nAvailable options:\n");
+        printf("  -h, --help         this help\n");
+        printf("  -b, --block        use blocking read mode on stdin\n");
+        printf("  -D, --direct       read files with O_DIRECT bypassing the page cache\n");
+        printf("  -o, --output=file  use this file for listing and statistics\n");
+        printf("  -l, --list         list all packets\n");
+        printf("  -s, --strip=file   write the stream without private streams to file\n");
+        printf("  -c, --cut=file     write the parts within the marks to file\n");
+        printf("  -m, --marks=list   marks h:mm:ss[.ff]-h:mm:ss[.ff][,...] for cutting\n");
+        printf("  -i, --index=file   write an index.vdr to file\n");
+        printf("  -a, --audio        show statistics of the audio streams\n");
+        printf("\nAll selected jobs are done within one pass over the input.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    bool block = false;
+    int mode = HANDLE_ASYNC;
+    cHandle *handle;
+    cDemux demux;
+    cCut *cut = NULL;
+    char *marks = NULL;
+    FILE *fp;
+    int c;
+
+    while ((c = getopt_long(argc, argv, "bDo:ls:c:m:i:ah", long_option, NULL)) > 0) {
+	switch (c) {
+	case 'b':
+	    block = true;
+	    break;
+	case 'D':
+	    mode |= HANDLE_DIRECT;
+	    break;
+	case 'o':
+	    if (!(out = create(optarg))) {
+		help();
+		exit(1);
+	    }
+	    break;
+	case 'l':
+	    demux.Add(new cList(out));
+	    break;
+	case 's':
+	    if (!(fp = create(optarg)) || !demux.Add(new cStrip(fp))) {
+		help();
+		exit(1);
+	    }
+	    break;
+	case 'c':
+	    if (!(fp = create(optarg)) || !demux.Add(cut = new cCut(fp))) {
+		help();
+		exit(1);
+	    }
+	    break;
+	case 'm':
+	    marks = optarg;
+	    break;
+	case 'i':
+	    if (!(fp = create(optarg)) || !demux.Add(new cIndex(fp))) {
+		help();
+		exit(1);
+	    }
+	    break;
+	case 'a':
+	    demux.Add(new cAudio(out));
+	    break;
+	case 'h':
+	    help();
+	    exit(0);
+	    break;
+	default:
+	    help();
+	    exit(1);
+	    break;
+	}
+    }
+    if (cut && (!marks || !cut->Marks(marks))) {
+	help();
+	exit(1);
+    }
+    argv += optind;
+    argc -= optind;
+    if (*argv && **argv == '-') {
+	argv++;
+	argc--;
+    }
+
+    install_sighandler(SIGINT);
+    install_sighandler(SIGQUIT);
+    install_sighandler(SIGHUP);
+    install_sighandler(SIGTERM);
+    install_sighandler(SIGPIPE);
+    install_sighandler(SIGIO);
+
+#   define STEPSIZE	DEMUX_STEPSIZE
+#   define OVERALL	(16*STEPSIZE)
+    static uint_8* buf = (uint_8*)valloc(OVERALL);	// Page aligned for O_DIRECT
+
+    if (!buf)
+	exit(1);
+
+    bool loop = true;
+    while (true) {
+	int fd = STDIN_FILENO;
+
+	if (argc <= 0) {
+	    if (!loop)
+		break;
+	    if (!block && fd == STDIN_FILENO) {
+		int flags = fcntl(fd, F_GETFL);
+		if (flags >= 0) {
+		    if (fcntl(fd, F_SETFL, (flags|O_PIPE)) < 0 ||
+			fcntl(fd, F_SETOWN, getpid()) < 0)
+			dsyslog("Couldn't set NONBLOCK|ASYNC mode on stdin: %s", strerror(errno));
+		}
+	    }
+	} else {
+	    if (!*argv)
+		break;
+	    if ((fd = open(*argv, O_NOCTTY|O_RDONLY)) < 0) {
+		dsyslog("Couldn't open file %s: %s", *argv, strerror(errno));
+		exit(1);
+	    }
+	    argv++;
+	    argc--;
+	}
+	loop = false;
+
+	handle = new cHandle(&buf[0], OVERALL, STEPSIZE, fd, mode);
+
+	demux.Scan(*handle);
+
+	if (handle) {
+	    delete handle;
+	    handle = NULL;
+	}
+
+	if (fd != STDIN_FILENO)
+	    close (fd);
+    }
+    demux.Done();
+
+    if (demux.Errors())
+	dsyslog("%llu packets, %llu errors", demux.Packets(), demux.Errors());
+
+    free(buf);
+    return 0;
+}
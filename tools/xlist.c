@@ -40,245 +40,13 @@
 #include <getopt.h>
 #include <signal.h>
 #include <netinet/in.h>
-
-#ifndef AARONS_TYPES
-#define AARONS_TYPES
-typedef unsigned long long uint_64;
-typedef unsigned int   uint_32;
-typedef unsigned short uint_16;
-typedef unsigned char  uint_8;
-
-typedef signed long long sint_64;
-typedef signed int     sint_32;
-typedef signed short   sint_16;
-typedef signed char    sint_8;
-#endif
+#include <stdarg.h>
+#include "handle.h"
+#include "xrecord.h"
 
 #define dsyslog(format, args...)	fprintf(stderr, "xlist: " format "\n\r", ## args)
 #define O_PIPE				(O_NONBLOCK|O_ASYNC)
 
-// Exeption class
-class cExeption {
-public:
-    const int reason;
-    cExeption(const int Reason) : reason(Reason) {};
-};
-
-class cHandle {
-private:
-    uint_64 offset;
-    uint_8 *const data;
-    uint_8 * curr;
-    const size_t size;
-    const size_t over;
-    volatile size_t left;
-    volatile size_t head;
-    volatile size_t tail;
-    volatile size_t avail;
-    int fd;
-    cExeption ex;
-    inline bool watch(unsigned long int ms)
-    {
-	fd_set watch;
-	suseconds_t usec = ms*1000;
-	struct timeval tv = { 0, usec};
-
-	FD_ZERO(&watch);
-	FD_SET(fd, &watch);
-
-	int ret = 0;
-	do {
-	    errno = 0;
-	    ret = select(fd+1, &watch, (fd_set*)0, (fd_set*)0, &tv);
-	} while (ret < 0 && errno == EINTR);
-
-	if (tv.tv_usec == usec)
-	    ret = -1;
-	return (ret > 0) ? FD_ISSET(fd, &watch) : false;
-    }
-    void refill(void) throw(cExeption)
-    {
-	size_t free;
-
-	if (fd < 0)		// Static buffer, skip
-	    goto out;
-
-	if (!(free = (size - avail)))
-	    goto out;
-
-	do {
-	    size_t  put = (tail+free > size) ? size - tail : free;
-	    ssize_t real = read(fd, data+tail, put);
-	    if (real < 0) {
-		if (errno == EINTR || errno == EAGAIN)
-		    continue;
-		throw ex;
-	    }
-	    if (real == 0) {
-		if (watch(320))
-		    continue;
-		fd = -1;	// Nothing new, we now have a static buffer
-		break;
-	    }
-	    avail += real;
-	    free  -= real;
-	    tail   = (tail + real) % size;
-
-	} while (free);
-    out:
-	return;
-    };
-    inline void rolling(const size_t pos)
-    {
-	ssize_t roll;
-	//
-	// Case of rolling the memory window over the end of the ring
-	// buffer, just copy the data from the buffer begin to the
-	// overroll area to get one continues memory window.
-	//
-	if ((pos < size) && ((roll = (pos+over) - size) > 0))
-	    memcpy(data+size, data, roll);
-    }
-    inline void movwin(const size_t len)
-    {
-	size_t  want, pos = head;
-
-	if (!len || (over && (len > over)))
-	    goto out;
-
-	if ((fd >= 0) && (avail < size/2))
-	    (void)refill();
-
-	if (avail == 0)
-	    goto out;
-
-	if ((want = len) > avail)
-	    want = avail;
-
-	pos += want;
-	if (over)
-	    rolling(pos);
-
-	head = pos % size;
-	curr = data+head;
-	avail -= want;
-	offset += want;
-    out:
-	return;
-    };
-    inline bool check(const size_t off) throw(cExeption)
-    {
-	if ((fd >= 0) && (avail < size/2))
-	    (void)refill();
-	left = avail;
-	if (over) {
-	    if (left > over)
-		left = over;
-	    rolling(head+off);
-	}
-	if (left < off)
-	    throw ex;
-	return true;
-    }
-public:
-	//
-	// Dynamic buffers filled from file opened with descriptor `file'
-	// or static buffer aready filled.  In case of a dynamic filter
-	// you may provide a minimal memory window step size to be able
-	// to ensure continues buffers from operators even if a buffer
-	// boundary is reached.
-	//
-    cHandle(uint_8 *buf, size_t len, const size_t step = 0, const int file = -1)
-    : data(buf), curr(data), size(len-step), over(step), fd(file), ex(1)
-    {
-	avail = head = tail = 0;
-	offset = 0;
-	if (fd < 0) {		// For static buffers we assume a filled buffer
-	    tail  += size;
-	    avail += size;
-	} else
-	    (void)refill();
-    };
-	//
-	// Return current offset
-	//
-    virtual const uint_64 Offset() const { return offset; };
-	//
-	// Return unsigned character value of
-	// current buffer position
-	//
-    inline operator uint_8  () { return check(1) ? *curr : 0; };
-	//
-	// Return unsigned short value of current
-	// buffer position (in big endian order)
-	//
-    inline operator uint_16 () { return check(2) ? ntohs(*((uint_16*)curr)) : 0; };
-	//
-	// Return unsigned int value of current
-	// buffer position (in big endian order)
-	//
-    inline operator uint_32 () { return check(4) ? ntohl(*((uint_32*)curr)) : 0; };
-	//
-	// Returns true if buffer has at least one
-	// left member
-	//
-    inline operator bool    () { return check(1); };
-	//
-	// A few useful relational operators
-	//
-    inline bool operator >= (const uint_32 &o) { return		 (avail >= (const size_t) o); };
-    inline bool operator >= (const int     &o) { return ((ssize_t)avail >= (const ssize_t)o); };
-    inline bool operator >  (const uint_32 &o) { return		 (avail >  (const size_t) o); };
-    inline bool operator >  (const int     &o) { return ((ssize_t)avail >  (const ssize_t)o); };
-    inline bool operator <= (const uint_32 &o) { return		 (avail <= (const size_t) o); };
-    inline bool operator <= (const int     &o) { return ((ssize_t)avail <= (const ssize_t)o); };
-    inline bool operator <  (const uint_32 &o) { return		 (avail <  (const size_t) o); };
-    inline bool operator <  (const int     &o) { return ((ssize_t)avail <  (const ssize_t)o); };
-    inline bool operator == (const uint_32 &o) { return		 (avail == (const size_t) o); };
-    inline bool operator == (const int     &o) { return ((ssize_t)avail == (const ssize_t)o); };
-    inline bool operator != (const uint_32 &o) { return		 (avail != (const size_t) o); };
-    inline bool operator != (const int     &o) { return ((ssize_t)avail != (const ssize_t)o); };
-	//
-	// Skip current read position, goto next (++x).
-	//
-    inline cHandle& operator ++()      { movwin(1); return *this; };
-	//
-	// Skip current read position, goto next.
-	// Return previous (x++).
-	//
-    inline cHandle  operator ++(int)
-    {
-	check(1);		// Before moving position, check and maybe rolling over
-	const cHandle ret(*this); movwin(1); return ret;
-    };
-	//
-	// Skip o positions from current read
-	// position (x += o).
-	//
-    inline cHandle& operator +=(const size_t& o) { movwin(o); return *this; };
-	//
-	// Return current buffer position with at least
-	// o members included. Do not use any position
-	// operator during usage of the pointer to this
-	// buffer position
-	//
-    inline uint_8*  operator ()(const size_t& o) { return check(o) ? curr : NULL; }
-	//
-	// Return left members of buffer. Should be less or
-	// equal to step size if step size is larger than zero.
-	//
-    inline const size_t len(void) { check(0); return left; };
-	//
-	// Exeption handling: you should use this instead
-	// of `while (handle)' or `if (handle)' ... this
-	// avoids checks for potential buffer shortage.
-	//
-#   define foreach(handle)	try { while ((handle))
-#   define test(handle)		try { if((handle))
-#   define end(handle)		} catch (cExeption& ex) { if (ex.reason != 1) throw; }
-
-};
-
 // Signal handling
 static struct sigaction saved_act[SIGUNUSED];
 static void sighandler(int sig)
@@ -323,13 +91,17 @@ static void install_sighandler(int sig)
 
 // Known options
 static FILE* out = stdout;
-#define D(format, args...)		fprintf(out, format "\n", ## args)
-#define N(format, args...)		fprintf(out, format,      ## args)
-#define nl				putc('\n', out);
+static bool binary = false;
+static void print(const char *format, ...) __attribute__((format(printf,1,2)));
+#define D(format, args...)		print(format "\n", ## args)
+#define N(format, args...)		print(format,      ## args)
+#define nl				print("\n");
 static struct option long_option[] =
 {
     {"help",      0, NULL,  'h'},
     {"block",     0, NULL,  'b'},
+    {"direct",    0, NULL,  'D'},
+    {"binary",    0, NULL,  'B'},
     {"output",    1, NULL,  'o'},
     {"noslices",  1, NULL,  's'},
     {"noaudpay",  1, NULL,  'a'},
@@ -343,7 +115,9 @@ static void help(void)
         printf("\nAvailable options:\n");
         printf("  -h, --help         this help\n");
         printf("  -b, --block        use blocking read mode on stdin\n");
+        printf("  -D, --direct       read files with O_DIRECT bypassing the page cache\n");
         printf("  -o, --output=file  use this file for output\n");
+        printf("  -B, --binary       write fixed width binary records, see xrecord.h\n");
         printf("  -s, --noslices     do not show video slice nor sequences\n");
         printf("  -a, --noaudpay     do not show payload of audio streams\n");
         printf("  -d, --nobdpay      do not show payload of private stream 1\n");
@@ -359,15 +133,22 @@ static void scan(cHandle handle);
 int main(int argc, char *argv[])
 {
     bool block = false;
+    int mode = HANDLE_ASYNC;
     cHandle *handle;
     char *output;
     int c;
 
-    while ((c = getopt_long(argc, argv, "bo:hsad", long_option, NULL)) > 0) {
+    while ((c = getopt_long(argc, argv, "bBDo:hsad", long_option, NULL)) > 0) {
 	switch (c) {
 	case 'b':
 	    block = true;
 	    break;
+	case 'D':
+	    mode |= HANDLE_DIRECT;
+	    break;
+	case 'B':
+	    binary = true;
+	    break;
 	case 'o':
 	    if (!optarg || *optarg == '-') {
 		help();
@@ -418,11 +199,16 @@ int main(int argc, char *argv[])
 
 #   define STEPSIZE	 4096
 #   define OVERALL	(128*STEPSIZE)
-    static uint_8* buf = (uint_8*)malloc(OVERALL);
+    static uint_8* buf = (uint_8*)valloc(OVERALL);	// Page aligned for O_DIRECT
 
     if (!buf)
 	exit(1);
 
+    if (binary && xrec_header(out) < 0) {
+	dsyslog("Couldn't write output: %s", strerror(errno));
+	exit(1);
+    }
+
     bool loop = true;
     while (true) {
 	int fd = STDIN_FILENO;
@@ -450,7 +236,7 @@ int main(int argc, char *argv[])
 	}
 	loop = false;
 
-	handle = new cHandle(&buf[0], OVERALL, STEPSIZE, fd);
+	handle = new cHandle(&buf[0], OVERALL, STEPSIZE, fd, mode);
 
 	scan(*handle);
 
@@ -467,6 +253,59 @@ int main(int argc, char *argv[])
     return 0;
 }
 
+//
+// Text output is skipped for binary records, but the arguments
+// are evaluated anyway as they may move the handle.
+//
+static void print(const char *format, ...)
+{
+    va_list ap;
+    if (binary)
+	return;
+    va_start(ap, format);
+    vfprintf(out, format, ap);
+    va_end(ap);
+}
+
+//
+// Binary records, the record of a pack or PES header is pending
+// until its time stamps are known.
+//
+static xrecord_t pending;
+static bool pended = false;
+static uint_8 stream;			// Stream id of the current PES packet
+
+static inline void R(const xrecord_t &rec)
+{
+    if (binary)
+	(void)xrec_write(out, &rec);
+}
+
+static inline void P(const uint_8 kind, const uint_64 offset, const uint_8 id, const uint_32 len)
+{
+    xrec_init(&pending, kind, offset, id, id);
+    pending.len = len;
+    pended = binary;
+}
+
+static inline void F(void)
+{
+    if (pended)
+	R(pending);
+    pended = false;
+}
+
+static inline uint_64 timestamp(const uint_8 *p)
+{
+    uint_64 ts;
+    ts  = (((uint_64)p[0]) & 0x0e) << 29;
+    ts |= ( (uint_64)p[1])         << 22;
+    ts |= (((uint_64)p[2]) & 0xfe) << 14;
+    ts |= ( (uint_64)p[3])         <<  7;
+    ts |= (((uint_64)p[4]) & 0xfe) >>  1;
+    return ts;
+}
+
 // PTS (Present Time Stamps)
 typedef struct _pts {
     uint_64 vid;
@@ -505,10 +344,13 @@ static void scan(cHandle handle)
 	    switch (ub) {
 	    case 0xb9:		// Program end (terminates a program stream)
 		D(" program_end");
+		P(XREC_OTHER, offset, ub, 0);
 		break;
 	    case 0xba:		// Pack header
+		P(XREC_PACK, offset, ub, 0);
 		if ((l & 0xc0) != 0x40) {
 		    mpeg_v1 = true;
+		    pending.flags |= XREC_F_MPEG1;
 		    N(" pack_header");
 		    for (int i = 4; i < 12; i++)
 			N(" %02x", (uint_8)handle++);
@@ -571,12 +413,15 @@ static void scan(cHandle handle)
 			N(", mux_rate: %lluB", muxrt);
 		    N(", scr90: %llums", scr90/90);
 		    nl;
+		    pending.pts  = scr90;
+		    pending.info = (uint_32)muxrt;
 		}
 		break;
 	    case 0xbb:		// System Header
 		handle += 2;
 		N(" system_header");
 		N(", len=%4d", m+6);
+		P(XREC_SYSTEM, offset, ub, m+6);
 		N(", ext:");
 		for (int i = 0; i < m && i < 20; i++)
 		     N(" %02x", (uint_8)handle++);
@@ -584,11 +429,13 @@ static void scan(cHandle handle)
 		break;
 	    case 0xbc:		// Program Stream Map
 		D(" program_stream_map");
+		P(XREC_OTHER, offset, ub, 0);
 		break;
 	    case 0xbd:		// Private stream 1
 		handle += 2;
 		N(" private_stream_1");
 		N(", len=%4d", m+6);
+		P(XREC_PES, offset, ub, m+6);
 		{
 		    uint_8 *p;
 		    uint_8  h;
@@ -608,10 +455,12 @@ static void scan(cHandle handle)
 		    b = handle;
 		    if ((b & 0xC000) != 0x8000) {
 			mpeg_v1 = true;
+			pending.flags |= XREC_F_MPEG1;
 			D(" (broken, no AC52 in Mpeg V1 multiplex)");
 			break;
 		    }
 		    if (b & 0x0400) N(", aligned");
+		    if (b & 0x0400) pending.flags |= XREC_F_ALIGNED;
 
 		    off_t off;
 		    N(", ext:");
@@ -626,6 +475,9 @@ static void scan(cHandle handle)
 			lpts |= ( (uint_64)p[6])         <<  7;
 			lpts |= (((uint_64)p[7]) & 0xfe) >>  1;
 			N(", pts: %llums", lpts/90);
+			pending.pts = lpts;
+			if (((p[1] & 0xc0) == 0xc0) && (p[2] >= 10))
+			    pending.dts = timestamp(&p[8]);
 			if (pts.vid) {
 			    sint_64 off = lpts - pts.vid;
 			    N("(%lldms)", off/90);
@@ -639,6 +491,8 @@ static void scan(cHandle handle)
 			    pts.ps1 = lpts;
 		    }
 
+		    stream = ub;
+		    F();
 		    if (skip_bd_pay)
 			handle += m;
 		    else
@@ -647,6 +501,7 @@ static void scan(cHandle handle)
 		nl;
 		break;
 	    case 0xbe:		// Padding stream
+		P(XREC_PES, offset, ub, m+6);
 		handle += 2;
 		l = handle;
 		if (l != 0xff)
@@ -657,11 +512,13 @@ static void scan(cHandle handle)
 	    case 0xbf:		// Private stream 2
 		handle += (2+m);
 		D(" private_stream_2, len=%4d", m+6);
+		P(XREC_PES, offset, ub, m+6);
 		break;
 	    case 0xc0 ... 0xdf:	// MPEG-1 or MPEG-2 audio stream
 		handle += 2;
 		N(" audio_stream(%d)", (ub & 0x1f));
 		N(", len=%4d", m+6);
+		P(XREC_PES, offset, ub, m+6);
 		{
 		    uint_8  *p;
 		    uint_8  h;
@@ -680,6 +537,7 @@ static void scan(cHandle handle)
 
 		    if ((b & 0xC000) != 0x8000) {
 			mpeg_v1 = true;
+			pending.flags |= XREC_F_MPEG1;
 			h = 0;
 
 			while (p[h] == 0xff) h++;
@@ -690,6 +548,8 @@ static void scan(cHandle handle)
 			if (p[h] & 0x30) {
 			    haspts = true;
 			    v = h;
+			    if ((p[h] & 0x30) == 0x30)
+				pending.dts = timestamp(&p[h+5]);
 			    if (p[h] & 0x10)
 				h += 10;
 			    else
@@ -702,7 +562,11 @@ static void scan(cHandle handle)
 			    break;
 			if (b & 0x0400)
 			    N(", aligned");
+			if (b & 0x0400)
+			    pending.flags |= XREC_F_ALIGNED;
 			haspts = (p[1] & 0x80) && (p[2] >= 5);
+			if (((p[1] & 0xc0) == 0xc0) && (p[2] >= 10))
+			    pending.dts = timestamp(&p[8]);
 		    }
 
 		    if (p[0]&0x04)
@@ -722,6 +586,7 @@ static void scan(cHandle handle)
 			lpts |= (((uint_64)p[v+2]) & 0xfe) << 14;
 			lpts |= ( (uint_64)p[v+3])         <<  7;
 			lpts |= (((uint_64)p[v+4]) & 0xfe) >>  1;
+			pending.pts = lpts;
 			N(", pts: %llums", lpts/90);
 			if (pts.vid) {
 			    sint_64 off = lpts - pts.vid;
@@ -738,6 +603,8 @@ static void scan(cHandle handle)
 			}
 		    }
 
+		    stream = ub;
+		    F();
 		    if (skip_audpay)
 			handle += m;
 		    else
@@ -749,6 +616,7 @@ static void scan(cHandle handle)
 		handle += 2;
 		N(" video_stream(%d)", (ub & 0x0f));
 		N(", len=%4d", m+6);
+		P(XREC_PES, offset, ub, m+6);
 		{
 		    uint_8 *p;
 		    uint_8 h;
@@ -766,6 +634,7 @@ static void scan(cHandle handle)
 
 		    if ((b & 0xC000) != 0x8000) {
 			mpeg_v1 = true; 
+			pending.flags |= XREC_F_MPEG1;
 			h = 0;
 
 			while (p[h] == 0xff) h++;
@@ -776,6 +645,8 @@ static void scan(cHandle handle)
 			if (p[h] & 0x30) {
 			    haspts = true;
 			    v = h;
+			    if ((p[h] & 0x30) == 0x30)
+				pending.dts = timestamp(&p[h+5]);
 			    if (p[h] & 0x10)
 				h += 10;
 			    else
@@ -788,7 +659,11 @@ static void scan(cHandle handle)
 			    break;
 			if (b & 0x0400)
 			    N(", aligned");
+			if (b & 0x0400)
+			    pending.flags |= XREC_F_ALIGNED;
 			haspts = (p[1] & 0x80) && (p[2] >= 5);
+			if (((p[1] & 0xc0) == 0xc0) && (p[2] >= 10))
+			    pending.dts = timestamp(&p[8]);
 		    }
 
 		    off_t off;
@@ -803,6 +678,7 @@ static void scan(cHandle handle)
 			lpts |= (((uint_64)p[v+2]) & 0xfe) << 14;
 			lpts |= ( (uint_64)p[v+3])         <<  7;
 			lpts |= (((uint_64)p[v+4]) & 0xfe) >>  1;
+			pending.pts = lpts;
 			if (pts.vid) {
 			    sint_64 diff = lpts - pts.vid;
 			    N(", pts: %llums        %lldms", lpts/90, diff/90);
@@ -814,6 +690,8 @@ static void scan(cHandle handle)
 			}
 		    }
 
+		    stream = ub;
+		    F();
 		    if (skip_slices)
 			handle += m;
 		    else
@@ -823,46 +701,60 @@ static void scan(cHandle handle)
 		break;
 	    case 0xf0:		// ECM Stream
 		D(" ECM Stream");
+		P(XREC_OTHER, offset, ub, 0);
 		break;
 	    case 0xf1:		// EMM Stream
 		D(" EMM Stream");
+		P(XREC_OTHER, offset, ub, 0);
 		break;
 	    case 0xf2:		// ITU-T Rec. H.222.0
 				// ISO/IEC 13818-1 Annex A or ISO/IEC 13818-6 DSMCC stream
 		D(" ITU-T Rec. H.222.0 | ISO/IEC 13818-1 | ISO/IEC 13818-6 DSMCC");
+		P(XREC_OTHER, offset, ub, 0);
 		break;
 	    case 0xf3:		// ISO/IEC_13522_stream
 		D(" ISO/IEC_13522_stream");
+		P(XREC_OTHER, offset, ub, 0);
 		break;
 	    case 0xf4:		// ITU-T Rec. H.222.1 type A
 		D(" ITU-T Rec. H.222.1 type A");
+		P(XREC_OTHER, offset, ub, 0);
 		break;
 	    case 0xf5:		// ITU-T Rec. H.222.1 type B
 		D(" ITU-T Rec. H.222.1 type B");
+		P(XREC_OTHER, offset, ub, 0);
 		break;
 	    case 0xf6:		// ITU-T Rec. H.222.1 type C
 		D(" ITU-T Rec. H.222.1 type C");
+		P(XREC_OTHER, offset, ub, 0);
 		break;
 	    case 0xf7:		// ITU-T Rec. H.222.1 type D
 		D(" ITU-T Rec. H.222.1 type D");
+		P(XREC_OTHER, offset, ub, 0);
 		break;
 	    case 0xf8:		// ITU-T Rec. H.222.1 type E
 		D(" ITU-T Rec. H.222.1 type E");
+		P(XREC_OTHER, offset, ub, 0);
 		break;
 	    case 0xf9:		// ancillary_stream
 		D(" ancillary_stream");
+		P(XREC_OTHER, offset, ub, 0);
 		break;
 	    case 0xff:		// Program Stream Directory
 		D(" program_stream_directory");
+		P(XREC_OTHER, offset, ub, 0);
 		break;
 	    default:
 		D(" unkown or reserved %08x", ul);
+		P(XREC_OTHER, offset, ub, 0);
 		break;
 	    }
+	    F();
 	} else {
 	    handle++;
 	}
     } end (handle);
+    F();
 };
 
 static off_t scan_e0(uint_8* const buf, const off_t rest, const uint_16 flags, const uint_64 deep)
@@ -881,6 +773,9 @@ static off_t scan_e0(uint_8* const buf, const off_t rest, const uint_16 flags, c
 	    uint_16 m  = (uint_16)((n>>16)&0x0000ffff);
 	    uint_8  l  = (uint_8) ((m>> 8)&0x00ff);
 
+	    xrecord_t r;
+	    xrec_init(&r, XREC_OTHER, offset, stream, ub);
+
 	    nl;
 	    N("%8llu %02X", offset, ub);
 	    switch (ub) {
@@ -896,8 +791,13 @@ static off_t scan_e0(uint_8* const buf, const off_t rest, const uint_16 flags, c
 		N(" picture_header -");
 		N(" vbv: %u,", (n >> 3) & 0x0000ffff);
 		N(" temporal_reference: %4d, picture_coding_type: %c", m>>6 , I_Frame);
+		r.kind  = XREC_PICTURE;
+		r.frame = I_Frame;
+		r.info  = m>>6;
+		r.extra = (n >> 3) & 0x0000ffff;
 		break;
 	    case 0x01 ... 0xaf:
+		r.kind = XREC_SLICE;
 		N(" slice");
 		for (int i = 0; i < 20; i++) {
 		    uint_32 n = handle;
@@ -914,6 +814,9 @@ static off_t scan_e0(uint_8* const buf, const off_t rest, const uint_16 flags, c
 		N(" height=%u width=%u", ((n&0xfff00000)>>20), ((n&0x000fff00)>> 8));
 		handle += 3;
 		l = handle;
+		r.kind  = XREC_SEQUENCE;
+		r.info  = (((n&0xfff00000)>>20)<<16)|((n&0x000fff00)>> 8);
+		r.extra = l;
 		N(" aspect=%u", (l & 0xf0) >> 4);
 		N(" rate=%u", (l & 0x0f));
 		handle += 4;
@@ -933,6 +836,8 @@ static off_t scan_e0(uint_8* const buf, const off_t rest, const uint_16 flags, c
 		break;
 	    case 0xb5:		// Extension
 		N(" extension_start");
+		r.kind = XREC_EXTENSION;
+		r.info = l>>4;
 		switch (l>>4) {
 		case 1:
 		    N(" (sequence_extension)");
@@ -966,12 +871,15 @@ static off_t scan_e0(uint_8* const buf, const off_t rest, const uint_16 flags, c
 		N(" group_of_pictures_header - time_code:");
 		N(" %02u:%02u:%02u.%02u", (n>>26)&0x1f, (n>>20)&0x3f, (n>>13)&0x3f, (n>>7)&0x3f);
 		N(" closed_gop: %d broken_link: %d", (n>>6)&0x01, (n>>5)&0x01);
+		r.kind = XREC_GOP;
+		r.info = (n>>7) & 0x01ffffff;
 		handle += 4;
 		break;
 	    default:
 		N(" unkown or reserved %08x", ul);
 		break;
 	    }
+	    R(r);
 	} else {
 	    handle++;
 	}
@@ -1009,6 +917,10 @@ static off_t scan_c0(uint_8* const buf, const off_t rest, const uint_16 flags, c
 
     if (len[id]) {
 	test(handle) {
+	    xrecord_t r;
+	    xrec_init(&r, XREC_REST, deep+handle.Offset(), stream, 0);
+	    r.len = len[id];
+	    R(r);
 	    nl;
 	    N("%8llu    mpeg audio rest=%d", deep+handle.Offset(), len[id]);
 	    handle += len[id];
@@ -1103,6 +1015,13 @@ static off_t scan_c0(uint_8* const buf, const off_t rest, const uint_16 flags, c
 	    target  = handle;
 	}
 #endif
+	xrecord_t r;
+	xrec_init(&r, XREC_MPA, offset, stream, 0xff);
+	r.len   = size;
+	r.frame = layer;
+	r.info  = rate;
+	r.extra = lpts;
+
 	nl;
 	N("%8llu FF mpeg audio layer=%d, len=%d", offset, layer, size);
 	if ((handle.Offset() - done) + size <= (uint_64)rest) {
@@ -1118,6 +1037,9 @@ static off_t scan_c0(uint_8* const buf, const off_t rest, const uint_16 flags, c
 	if (crc)
 	    N(", crc=0x%04x", target);
 #endif
+	if (stop)
+	    r.flags |= XREC_F_SPLIT;
+	R(r);
 	if (stop)
 	    break;
 
@@ -1186,6 +1108,10 @@ static off_t scan_bd(uint_8* const buf, const off_t rest, const uint_16 flags, c
 		if ((len == 0) || haspts) {
 		    substream = true;
 		    len = (uint_16)handle;
+		    xrecord_t r;
+		    xrec_init(&r, XREC_SPU, deep+handle.Offset()-1, stream, ub);
+		    r.len = len;
+		    R(r);
 		    nl;
 		    N("%8llu %02X", deep+handle.Offset()-1, (ub & 0xf8));
 		    N(" substream(subpicture), len=%d spuh:", len);
@@ -1194,6 +1120,10 @@ static off_t scan_bd(uint_8* const buf, const off_t rest, const uint_16 flags, c
 		    len -= (rest - 1);
 		} else if (len) {
 		    substream = true;
+		    xrecord_t r;
+		    xrec_init(&r, XREC_REST, deep+handle.Offset()-1, stream, ub);
+		    r.len = len;
+		    R(r);
 		    nl;
 		    N("%8llu %02X", deep+handle.Offset()-1, (ub & 0xf8));
 		    N(" substream(subpicture), rest=%d", len);
@@ -1209,6 +1139,11 @@ static off_t scan_bd(uint_8* const buf, const off_t rest, const uint_16 flags, c
 	    m = handle;
 	    if (m == 0x0b77) {
 		substream = true;
+		xrecord_t r;
+		xrec_init(&r, XREC_AC3, deep+handle.Offset()-o, stream, ub);
+		r.info  = c;
+		r.extra = o - 3;
+		R(r);
 		nl;
 		N("%8llu %02X", deep+handle.Offset()-o, (ub & 0xf8));
 		N(" substream(AC3), stream: %u, count: %u, start: %lu", (ub & 7), c, o - 3);
@@ -1221,6 +1156,11 @@ static off_t scan_bd(uint_8* const buf, const off_t rest, const uint_16 flags, c
 	    n = handle;
 	    if (n == 0x7ffe8001) {
 		substream = true;
+		xrecord_t r;
+		xrec_init(&r, XREC_DTS, deep+handle.Offset()-o, stream, ub);
+		r.info  = c;
+		r.extra = o - 3;
+		R(r);
 		nl;
 		N("%8llu %02X", deep+handle.Offset()-o, (ub & 0xf8));
 		N(" substream(DTS), stream: %u, count: %u, start: %lu", (ub & 7), c, o - 3);
@@ -1239,6 +1179,10 @@ static off_t scan_bd(uint_8* const buf, const off_t rest, const uint_16 flags, c
 		if ((len == 0) || haspts) {
 		    substream = true;
 		    len = (rest - o);
+		    xrecord_t r;
+		    xrec_init(&r, XREC_LPCM, deep+handle.Offset(), stream, ub);
+		    r.len = len;
+		    R(r);
 		    nl;
 		    N("%8llu %02X", deep+handle.Offset(), (ub & 0xf8));
 		    N(" substream(PCM), len=%d, flags:", len);
@@ -1248,6 +1192,10 @@ static off_t scan_bd(uint_8* const buf, const off_t rest, const uint_16 flags, c
 		} else if (len) {
 		    substream = true;
 		    len = (rest - o);
+		    xrecord_t r;
+		    xrec_init(&r, XREC_REST, deep+handle.Offset(), stream, ub);
+		    r.len = len;
+		    R(r);
 		    nl;
 		    N("%8llu %02X", deep+handle.Offset(), (ub & 0xf8));
 		    N(" substream(PCM), rest=%d, flags", len);
@@ -1274,6 +1222,10 @@ nosub:
 	    if (aligned) len = 0;
 	    if (len) {
 		off_t off = handle.Offset();
+		xrecord_t r;
+		xrec_init(&r, XREC_REST, deep+off, stream, 0x0b);
+		r.len = len;
+		R(r);
 		handle += len;
 		nl;			// If not on boundary a overroll may occured
 		N("%8llu   ", deep+off);
@@ -1292,6 +1244,13 @@ nosub:
 		    frmsizecod	=  ((uint_8)handle)&0x3f;
 		    len = 2*frmsizecod_tbl[frmsizecod].frame_size[fscod];
 
+		    xrecord_t r;
+		    xrec_init(&r, XREC_AC3, deep+handle.Offset()-4, stream, 0x0b);
+		    r.len = len;
+		    if (l < len)
+			r.flags |= XREC_F_SPLIT;
+		    R(r);
+
 		    nl;
 		    N("%8llu 0B", deep+handle.Offset()-4);
 		    N(" plain(AC3) size=%d", len);
@@ -0,0 +1,93 @@
+/*
+ * xrecord.c:	Fixed width binary records written by `xlist -B'
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ * Copyright (C) 2003-2005 Werner Fink, <werner@suse.de>
+ */
+
+#include <string.h>
+#include <errno.h>
+#include "xrecord.h"
+
+void xrec_init(xrecord_t *rec, const uint_8 kind, const uint_64 offset,
+	       const uint_8 stream, const uint_8 code)
+{
+    memset(rec, 0, sizeof(xrecord_t));
+    rec->offset = offset;
+    rec->pts    = XREC_NOTS;
+    rec->dts    = XREC_NOTS;
+    rec->kind   = kind;
+    rec->stream = stream;
+    rec->code   = code;
+}
+
+int xrec_header(FILE *fp)
+{
+    xheader_t head;
+
+    memset(&head, 0, sizeof(xheader_t));
+    head.magic   = XREC_MAGIC;
+    head.version = XREC_VERSION;
+    head.order   = XREC_ORDER;
+    head.size    = sizeof(xrecord_t);
+    if (fwrite(&head, sizeof(xheader_t), 1, fp) != 1)
+	return -1;
+    return 0;
+}
+
+int xrec_write(FILE *fp, const xrecord_t *rec)
+{
+    if (fwrite(rec, sizeof(xrecord_t), 1, fp) != 1)
+	return -1;
+    return 0;
+}
+
+int xrec_check(FILE *fp)
+{
+    xheader_t head;
+
+    if (fread(&head, sizeof(xheader_t), 1, fp) != 1)
+	goto err;
+    if (head.magic != XREC_MAGIC || head.order != XREC_ORDER)
+	goto bad;		// Not a record file or foreign byte order
+    if (head.version != XREC_VERSION || head.size != sizeof(xrecord_t))
+	goto bad;
+    return 0;
+bad:
+    errno = EINVAL;
+err:
+    return -1;
+}
+
+ssize_t xrec_read(FILE *fp, xrecord_t *rec, const size_t n)
+{
+    size_t got = fread(rec, sizeof(xrecord_t), n, fp);
+    if (got < n && ferror(fp))
+	return -1;
+    return (ssize_t)got;
+}
+
+const char *xrec_kind(const uint_8 kind)
+{
+    static const char *const name[] = {
+	"unknown", "pack", "system", "pes", "sequence", "gop", "picture",
+	"slice", "extension", "mpa", "ac3", "dts", "lpcm", "spu", "rest", "other"
+    };
+    if (kind >= sizeof(name)/sizeof(name[0]))
+	return name[0];
+    return name[kind];
+}
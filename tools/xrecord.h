@@ -0,0 +1,127 @@
+/*
+ * xrecord.h:	Fixed width binary records written by `xlist -B'
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ * Copyright (C) 2003-2005 Werner Fink, <werner@suse.de>
+ */
+
+#ifndef __XRECORD_H
+#define __XRECORD_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#ifndef AARONS_TYPES
+#define AARONS_TYPES
+typedef unsigned long long uint_64;
+typedef unsigned int   uint_32;
+typedef unsigned short uint_16;
+typedef unsigned char  uint_8;
+
+typedef signed long long sint_64;
+typedef signed int     sint_32;
+typedef signed short   sint_16;
+typedef signed char    sint_8;
+#endif
+
+//
+// The file starts with one header followed by records of the same
+// size, all in host byte order.  Therefore the n-th record is found
+// at sizeof(xheader_t) + n * sizeof(xrecord_t), e.g. in a mapped
+// file, without parsing any of the records before.
+//
+#define XREC_MAGIC	0x54534c58	// "XLST"
+#define XREC_VERSION	1
+#define XREC_ORDER	0x0102		// Detect foreign byte order
+
+typedef struct _xheader {
+    uint_32 magic;
+    uint_16 version;
+    uint_16 order;
+    uint_16 size;			// sizeof(xrecord_t)
+    uint_16 pad[3];
+} xheader_t;
+
+//
+// Kind of a record
+//
+#define XREC_PACK	1		// Pack header, pts: system clock reference base,
+					// info: mux rate in byte/s
+#define XREC_SYSTEM	2		// System header
+#define XREC_PES	3		// PES packet, len: whole packet
+#define XREC_SEQUENCE	4		// Sequence header, info: horizontal<<16|vertical,
+					// extra: aspect<<4|frame rate code
+#define XREC_GOP	5		// Group of pictures, info: time code (25 bits)
+#define XREC_PICTURE	6		// Picture header, frame: 'I', 'P', 'B', 'D', or 0
+					// info: temporal reference, extra: vbv delay
+#define XREC_SLICE	7		// Slice, code: slice vertical position
+#define XREC_EXTENSION	8		// Extension, info: extension id
+#define XREC_MPA	9		// MPEG audio frame, frame: layer, info: sample rate
+					// extra: duration in 90kHz
+#define XREC_AC3	10		// AC3 frame or sub stream, code: sub stream id
+#define XREC_DTS	11		// DTS sub stream, code: sub stream id
+#define XREC_LPCM	12		// Linear PCM sub stream, code: sub stream id
+#define XREC_SPU	13		// Sub picture sub stream, code: sub stream id
+#define XREC_REST	14		// Rest of a frame started in a previous packet
+#define XREC_OTHER	15		// Other start codes
+
+//
+// Flags of a record
+//
+#define XREC_F_ALIGNED	0x01		// Data alignment indicator
+#define XREC_F_MPEG1	0x02		// MPEG-1 packet
+#define XREC_F_SPLIT	0x04		// Frame continues in next packet
+
+#define XREC_NOTS	(~0ULL)		// No PTS or DTS
+
+typedef struct _xrecord {
+    uint_64 offset;			// Absolute byte offset of the start
+    uint_64 pts;			// 90kHz, XREC_NOTS if not available
+    uint_64 dts;			// 90kHz, XREC_NOTS if not available
+    uint_32 len;			// Length of packet or frame
+    uint_32 info;			// See kind
+    uint_32 extra;			// See kind
+    uint_8  kind;			// XREC_*
+    uint_8  stream;			// Stream id of the PES packet
+    uint_8  code;			// Start code or sub stream id
+    uint_8  flags;			// XREC_F_*
+    uint_8  frame;			// See kind
+    uint_8  pad[7];
+} xrecord_t;
+
+//
+// Initialize a record, both time stamps are set to XREC_NOTS
+//
+extern void xrec_init(xrecord_t *rec, const uint_8 kind, const uint_64 offset,
+		      const uint_8 stream, const uint_8 code);
+//
+// Writer: header once, then the records
+//
+extern int xrec_header(FILE *fp);
+extern int xrec_write(FILE *fp, const xrecord_t *rec);
+//
+// Reader: check the header and read up to n records at once,
+// returns the number of records read or -1 on error
+//
+extern int xrec_check(FILE *fp);
+extern ssize_t xrec_read(FILE *fp, xrecord_t *rec, const size_t n);
+//
+// Name of the kind of a record
+//
+extern const char *xrec_kind(const uint_8 kind);
+
+#endif // __XRECORD_H
@@ -165,32 +165,8 @@ typedef signed char		sint_8;
 # include <linux/rtc.h>
 # include <sys/ioctl.h>
 # define debug(args...)
-# define realtime(name)									\
-    if (getuid() == 0) {								\
-	const pthread_t self = pthread_self();						\
-	/* We increase priority to decrease delays */					\
-	struct sched_param param;							\
-	int policy = SCHED_RR;								\
-	(void)pthread_getschedparam(self, &policy, &param);				\
-	param.sched_priority = (sched_get_priority_max(policy)*4)/5;			\
-	if (pthread_setschedparam(self, policy, &param) < 0)				\
-	    esyslog(name " thread can not set scheduling priority: %s", strerror(errno));\
-	/* Free resources immediately on exit */					\
-	(void)pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);			\
-	(void)pthread_detach(self);							\
-	if (nice(-15) < 0 && errno)							\
-	    esyslog(name " thread can not set process priority: %s", strerror(errno));	\
-    } else {										\
-	/* Free resources immediately on exit */					\
-	(void)pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);			\
-	(void)pthread_detach(pthread_self());						\
-    }
 #else
 # define debug(args...)	fprintf(stderr, args)
-# define realtime(name)									\
-    /* Free resources immediately on exit */						\
-    (void)pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);			\
-    (void)pthread_detach(pthread_self());
 #endif
 
 #define test_and_set_flag(flag)		test_and_set_bit(FLAG_ ## flag, &flags)
@@ -207,6 +183,15 @@ typedef signed char		sint_8;
 # endif
 #endif
 
+//
+// Memory barrier for lock free single reader/writer rings
+//
+#if GCC_VERSION >= 4001
+# define mbarrier()	__sync_synchronize()
+#else
+# define mbarrier()	__vasm ("" ::: "memory")
+#endif
+
 #if 0 // GCC_VERSION >= 3003
 # define local	__thread
 #else
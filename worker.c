@@ -0,0 +1,139 @@
+/*
+ * worker.c:	Persistent threads running the forwarding loops
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ * Copyright (C) 2005 Werner Fink, <werner@suse.de>
+ */
+
+#include <time.h>
+#include <vdr/tools.h>
+#include "worker.h"
+#include "realtime.h"
+
+// --- cWorker : Persistent thread running one session after the other ----------------
+
+cWorker::cWorker(const char *Description, bool realtime)
+:cThread(Description), mutex(), done(), next(), session(NULL),
+ busy(false), stop(false), alive(false), rt(realtime), self(0)
+{
+}
+
+cWorker::~cWorker()
+{
+    Exit();
+}
+
+void cWorker::Action(void)
+{
+    if (rt)
+	rt_thread(RT_OUTPUT, "WORKER: ");
+    self = pthread_self();
+
+    mutex.Lock();
+    while (!stop) {
+	cSession *s = session;
+
+	if (!s) {
+	    next.Wait(mutex);
+	    continue;
+	}
+
+	busy = true;
+	mutex.Unlock();
+	s->Session(this);
+	mutex.Lock();
+	busy = false;
+
+	if (session == s)
+	    session = NULL;
+	done.Broadcast();
+    }
+    alive = false;				// Joined by Exit()
+    done.Broadcast();
+    mutex.Unlock();
+}
+
+void cWorker::Run(cSession *s)
+{
+    bool start;
+
+    mutex.Lock();
+    session = s;
+    stop = false;
+    next.Broadcast();
+    if ((start = !alive))
+	alive = true;				// Only once: Start() may sleep
+    mutex.Unlock();
+    if (start && !Start()) {
+	mutex.Lock();
+	alive = false;
+	session = NULL;
+	mutex.Unlock();
+	esyslog("WORKER: can not start thread");
+    }
+}
+
+bool cWorker::Stop(cSession *s, int msec)
+{
+    bool ret = true;
+
+    mutex.Lock();
+    if (session != s)
+	goto out;				// Not ours or already done
+
+    if (!busy) {
+	session = NULL;				// Not yet begun
+	goto out;
+    }
+
+    if (pthread_equal(self, pthread_self()))
+	goto out;				// Called within the session
+
+    s->Wakeup();
+    while (session == s) {
+	if (msec < 0) {
+	    done.Wait(mutex);
+	    continue;
+	}
+	if (!done.TimedWait(mutex, msec)) {
+	    ret = (session != s);
+	    break;
+	}
+    }
+out:
+    mutex.Unlock();
+    return ret;
+}
+
+//
+// The thread is never cancelled as it may hold the mutex or wait
+// on the conditions, it leaves the loop on the stop token and is
+// joined on the end of Action().
+//
+void cWorker::Exit(void)
+{
+    const struct timespec tick = { 0, 1000000 };
+
+    mutex.Lock();
+    stop = true;
+    next.Broadcast();
+    while (alive)
+	done.Wait(mutex);
+    mutex.Unlock();
+    while (Active())				// Leaves Action() at once
+	nanosleep(&tick, NULL);
+}
@@ -0,0 +1,80 @@
+/*
+ * worker.h:	Persistent threads running the forwarding loops
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ * Or, point your browser to http://www.gnu.org/copyleft/gpl.html
+ *
+ * Copyright (C) 2005 Werner Fink, <werner@suse.de>
+ */
+
+#ifndef __WORKER_H
+#define __WORKER_H
+
+#include <pthread.h>
+#include <vdr/thread.h>
+#include "types.h"
+
+//
+// A loop run by a worker thread.  Session() returns if its own
+// stop token, e.g. the ACTIVE flag of the owner, was cleared.
+// Wakeup() is called by the stopping thread to interrupt the
+// waits of the loop.
+//
+class cSession {
+public:
+    virtual ~cSession() {};
+    virtual void Session(cThread *worker) = 0;
+    virtual void Wakeup(void) {};
+};
+
+//
+// The thread is created only once and then runs one session
+// after the other.  Stopping a session waits on its end with a
+// condition instead of polling the running state of the thread.
+//
+class cWorker : public cThread {
+private:
+    cMutex mutex;
+    cCondVar done;				// A session has ended
+    cCondVar next;				// A session was handed over
+    cSession *volatile session;			// Current or requested session
+    volatile bool busy;				// Session() is running
+    volatile bool stop;				// Stop token of the thread
+    volatile bool alive;			// Action() is running or about to
+    const bool rt;				// Use scheduling of RT_OUTPUT
+    pthread_t self;
+protected:
+    virtual void Action(void);
+public:
+    cWorker(const char *Description, bool realtime = true);
+    virtual ~cWorker();
+	//
+	// Run the session, the thread is started on first use
+	//
+    void Run(cSession *s);
+	//
+	// Wait up to msec on the end of the session, its stop token
+	// has to be cleared before.  Returns false on timeout, with a
+	// negative msec it waits until the session has ended.
+	//
+    bool Stop(cSession *s, int msec);
+	//
+	// Stop the thread itself and join it, all sessions have to be
+	// stopped before
+	//
+    void Exit(void);
+};
+
+#endif // __WORKER_H